@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "libhammer.h"
+
+/* CPU-side microbenchmarks of the setup and scan helpers.
+   Every benchmark runs BENCH_WARMUP untimed samples, then
+   BENCH_SAMPLES timed ones of ops operations each, and is
+   reported as ns/op statistics in one JSON document. */
+
+#define BENCH_WARMUP 5
+#define BENCH_SAMPLES 31
+#define BENCH_MAX_BUFFERS 16
+#define BENCH_POOL_SIZE 15000					// Conflict pool size of discover.c
+
+typedef struct __bench {
+	const char *name;
+	unsigned long ops;							// operations per sample
+	void (*run)(unsigned long ops);
+	unsigned long param;						// e.g. number of buffers, printed if set
+} bench_t;
+
+static hammer_ctx_t ctx;
+static uint8_t *pool[BENCH_POOL_SIZE];
+static volatile uint64_t sink;					// keeps results alive
+static unsigned bench_param;
+static int first_result = 1;
+
+static int u64_compare(const void *t1, const void *t2)
+{
+	uint64_t val1, val2;
+	val1 = *(uint64_t *) t1;
+	val2 = *(uint64_t *) t2;
+
+	return val1 > val2 ? 1 : (val1 < val2 ? -1 : 0);
+}
+
+/* ------------------------------ BENCHMARKS ------------------------------ */
+
+static void bench_dram_to_physical(unsigned long ops)
+{
+	dram_addr_t dram_addr;
+	unsigned long i;
+	unsigned j;
+
+	for(i = 0; i < ops; ++i) {
+		for(j = 0; j < ctx.dram.nmasks; ++j) {
+			dram_addr.ch_to_bank[j] = (i >> j) & 1;
+		}
+		dram_addr.row = i % ctx.dram.nrows;
+		sink += dram_to_physical(&ctx.dram, dram_addr);
+	}
+}
+
+/* Bank of an address, one parity per function mask */
+static void bench_bank_decode(unsigned long ops)
+{
+	uintptr_t addr;
+	unsigned long i;
+	unsigned j, bank;
+
+	for(i = 0; i < ops; ++i) {
+		addr = (uintptr_t) pool[i % BENCH_POOL_SIZE];
+		bank = 0;
+		for(j = 0; j < ctx.dram.nmasks; ++j) {
+			bank |= __builtin_parityl(addr & ctx.dram.function_masks[j]) << j;
+		}
+		sink += bank;
+	}
+}
+
+static void bench_calc_functions(unsigned long ops)
+{
+	uint64_t *functions;
+	unsigned long i;
+
+	for(i = 0; i < ops; ++i) {
+		functions = hammer_calc_functions(pool + 1, bench_param, pool[0]);
+		sink += functions ? functions[0] : 0;
+		free(functions);
+	}
+}
+
+/* Victim scan over a clean row (the common case) */
+static void bench_scan_clean(unsigned long ops)
+{
+	hammer_result_t result;
+	unsigned long i;
+
+	memset(&result, 0, sizeof(result));
+	result.victim = hammer_ctx_buffer(&ctx, 0);
+	result.victim_pattern = 0x00;
+	memset(result.victim, 0x00, ROW_SIZE);
+	for(i = 0; i < ops; ++i) {
+		result.flips = 0;
+		hammer_scan_victim(&result, NULL);
+		sink += result.flips;
+	}
+}
+
+/* Victim scan over a row with a flip every 64 bytes */
+static void bench_scan_flipped(unsigned long ops)
+{
+	hammer_result_t result;
+	unsigned long i;
+	unsigned j;
+
+	memset(&result, 0, sizeof(result));
+	result.victim = hammer_ctx_buffer(&ctx, 0);
+	result.victim_pattern = 0xFF;
+	memset(result.victim, 0xFF, ROW_SIZE);
+	for(j = ENTROPY_PADDING_SIZE; j < ROW_SIZE; j += 64) {
+		result.victim[j] = 0xFE;
+	}
+	for(i = 0; i < ops; ++i) {
+		result.flips = 0;
+		result.nrecorded = 0;
+		hammer_scan_victim(&result, NULL);
+		sink += result.flips;
+	}
+}
+
+/* Fill + entropy of bench_param buffers, the per-buffer setup cost */
+static void bench_fill_buffers(unsigned long ops)
+{
+	unsigned long i;
+	unsigned j;
+
+	for(i = 0; i < ops; ++i) {
+		for(j = 0; j < bench_param; ++j) {
+			hammer_fill_buffer(&ctx, hammer_ctx_buffer(&ctx, j), 0);
+		}
+	}
+}
+
+/* Flip recording at random pool addresses into an empty map */
+static void bench_flipmap_add(unsigned long ops)
+{
+	flipmap_t fm;
+	unsigned long i;
+
+	flipmap_init(&fm);
+	for(i = 0; i < ops; ++i) {
+		flipmap_add(&fm, (uintptr_t) pool[i % BENCH_POOL_SIZE], i % 8, i & 1 ? ZERO_TO_ONE : ONE_TO_ZERO);
+	}
+	sink += flipmap_bytes(&fm);
+	flipmap_free(&fm);
+}
+
+/* Lookups of the last element, set_contains() is a linear scan */
+static void bench_set_contains(unsigned long ops)
+{
+	unsigned long i;
+
+	for(i = 0; i < ops; ++i) {
+		sink += set_contains(pool, bench_param, pool[bench_param - 1]);
+	}
+}
+
+/* -------------------------------- HARNESS -------------------------------- */
+
+static void bench_report(const bench_t *bench, uint64_t *samples)
+{
+	double ns_op[BENCH_SAMPLES], mean, var;
+	unsigned i;
+
+	qsort(samples, BENCH_SAMPLES, sizeof(uint64_t), u64_compare);
+	mean = 0;
+	for(i = 0; i < BENCH_SAMPLES; ++i) {
+		ns_op[i] = (double) samples[i] / bench->ops;
+		mean += ns_op[i];
+	}
+	mean /= BENCH_SAMPLES;
+	var = 0;
+	for(i = 0; i < BENCH_SAMPLES; ++i) {
+		var += (ns_op[i] - mean) * (ns_op[i] - mean);
+	}
+	var /= BENCH_SAMPLES - 1;
+
+	printf("%s    {\"name\": \"%s\", \"param\": %lu, \"ops_per_sample\": %lu, \"samples\": %u, "
+		   "\"ns_per_op\": {\"min\": %0.3f, \"median\": %0.3f, \"mean\": %0.3f, \"stddev\": %0.3f, \"p95\": %0.3f, \"max\": %0.3f}}",
+		   first_result ? "" : ",\n", bench->name, bench->param, bench->ops, BENCH_SAMPLES,
+		   ns_op[0], ns_op[BENCH_SAMPLES / 2], mean, __builtin_sqrt(var),
+		   ns_op[(BENCH_SAMPLES * 95) / 100], ns_op[BENCH_SAMPLES - 1]);
+	first_result = 0;
+}
+
+static void bench_one(const bench_t *bench)
+{
+	uint64_t samples[BENCH_SAMPLES], t_start;
+	unsigned i;
+
+	bench_param = bench->param;
+	for(i = 0; i < BENCH_WARMUP; ++i) {
+		bench->run(bench->ops);
+	}
+	for(i = 0; i < BENCH_SAMPLES; ++i) {
+		t_start = timing_now_ns();
+		bench->run(bench->ops);
+		samples[i] = timing_now_ns() - t_start;
+	}
+	bench_report(bench, samples);
+}
+
+int main(int argc, char **argv)
+{
+	hammer_config_t conf;
+	unsigned i;
+	int rv;
+
+	static const bench_t benches[] = {
+		{"dram_to_physical",	1000000,	bench_dram_to_physical,	0},
+		{"bank_decode_parity",	1000000,	bench_bank_decode,		0},
+		{"calc_functions",		1,			bench_calc_functions,	1000},
+		{"scan_victim_clean",	1000,		bench_scan_clean,		0},
+		{"scan_victim_flipped",	1000,		bench_scan_flipped,		0},
+		{"fill_add_entropy",	1,			bench_fill_buffers,		1},
+		{"fill_add_entropy",	1,			bench_fill_buffers,		4},
+		{"fill_add_entropy",	1,			bench_fill_buffers,		BENCH_MAX_BUFFERS},
+		{"flipmap_add",			BENCH_POOL_SIZE,	bench_flipmap_add,	0},
+		{"set_contains",		1000,		bench_set_contains,		1000},
+		{"set_contains",		100,		bench_set_contains,		BENCH_POOL_SIZE},
+	};
+
+	memset(&conf, 0, sizeof(conf));
+	conf.numa_node = NUMA_NO_NODE;
+	conf.cpu = ENV_NO_CPU;
+	conf.dram_gen = argc > 1 ? argv[1] : "ddr3";
+	if((rv = hammer_ctx_init(&ctx, &conf))) {
+		fprintf(stderr, "[ERROR] Cannot set up context for %s (%d)\n", conf.dram_gen, rv);
+		return EXIT_FAILURE;
+	}
+	if((rv = hammer_ctx_map_buffers(&ctx, 1, BENCH_MAX_BUFFERS))) {
+		fprintf(stderr, "[ERROR] Cannot map buffers (%d)\n", rv);
+		return EXIT_FAILURE;
+	}
+
+	/* Random addresses in the first buffer, like the conflict pool */
+	srand(1);
+	for(i = 0; i < BENCH_POOL_SIZE; ++i) {
+		pool[i] = hammer_ctx_buffer(&ctx, 0) + rand() % BUFFER_SIZE;
+	}
+
+	printf("{\n  \"profile\": \"%s\",\n  \"tsc_ghz\": %0.3f,\n  \"warmup\": %u,\n  \"results\": [\n",
+		   ctx.dram.name, tsc_cal.ticks_per_ns, BENCH_WARMUP);
+	for(i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i) {
+		bench_one(&benches[i]);
+	}
+	printf("\n  ]\n}\n");
+
+	hammer_ctx_destroy(&ctx);
+	return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include "libhammer.h"
+
+#define BUDGET_PRIOR_WEIGHT 2.0				// Attempts the bank (or pool) mean is worth for a row
+#define BUDGET_EXPLORE 1.0					// Weight of the bonus for rarely tried rows
+#define BUDGET_SAVE_EVERY 64				// Jobs between history saves
+
+/* Yield of a logical bank/row position: flipped bits plus ECC errors
+   over the triplets hammered there, from the history and this run. */
+typedef struct __budget_stat {
+	uint64_t attempts;
+	uint64_t flips;
+	uint64_t ecc;
+} budget_stat_t;
+
+typedef struct __budget {
+	uint64_t budget_ns;
+	const char *history_path;			// NULL: no history
+	budget_stat_t rows[MAX_CONTROLLED_BANKS][MAX_CONTROLLED_ROWS];
+	uint64_t nhistory;					// attempts loaded from the history
+} budget_t;
+
+int budget_load_history(budget_t *budget, const char *path, const dram_profile_t *dram);
+int budget_save_history(budget_t *budget, const dram_profile_t *dram);
+int budget_run(hammer_ctx_t *ctx, budget_t *budget, unsigned first_slot, unsigned nbuffers);
+
+#endif
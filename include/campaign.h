@@ -0,0 +1,47 @@
+#ifndef CAMPAIGN_H
+#define CAMPAIGN_H
+
+#include "libhammer.h"
+
+#define CAMPAIGN_MAX_VALUES 16
+#define CAMPAIGN_LINE_MAX 512
+#define CAMPAIGN_DEFAULT_OUTPUT "campaign.csv"
+
+/* One axis value list per dimension of the sweep */
+typedef struct __campaign {
+	uint64_t activations[CAMPAIGN_MAX_VALUES];
+	unsigned nactivations;
+	uint64_t rounds[CAMPAIGN_MAX_VALUES];
+	unsigned nrounds;
+	uint8_t agg_patterns[CAMPAIGN_MAX_VALUES];
+	uint8_t victim_patterns[CAMPAIGN_MAX_VALUES];
+	unsigned npatterns;
+	unsigned banks[MAX_CONTROLLED_BANKS];
+	unsigned nbanks;
+	unsigned nbuffers;
+	char output[256];
+} campaign_t;
+
+/* One cell of the result matrix */
+typedef struct __campaign_cell {
+	uint64_t activations;
+	uint64_t rounds;
+	uint8_t agg_pattern;
+	uint8_t victim_pattern;
+	unsigned bank;
+	unsigned buffer;
+	unsigned jobs;
+	uint64_t flips;
+	uint64_t flips_0_to_1;
+	uint64_t flips_1_to_0;
+	uint64_t total_acts;
+	uint64_t elapsed_ns;
+	uint64_t edac_ce;						// ECC errors, corrected flips included
+	uint64_t edac_ue;
+	uint64_t load_bytes;					// background traffic while hammering (-L)
+} campaign_cell_t;
+
+int campaign_load(campaign_t *campaign, const char *path, const dram_profile_t *dram);
+int campaign_run(hammer_ctx_t *ctx, campaign_t *campaign, unsigned first_slot);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <pthread.h>
+#include "libhammer.h"
+
+#define COVERAGE_MAX_SLOTS 256				// 2MB slots, -N all needs NUMA_BUFFER_STRIDE per node
+#define COVERAGE_MAX_PATTERNS 8				// agg/victim pattern pairs per file
+#define COVERAGE_FLUSH_NS 1000000000ULL		// at most one rewrite per second while sweeping
+
+/* Triplets of a sweep which were hammered and scanned, by buffer
+   slot, bank, data patterns and victim row, for one configuration.
+   Shared by the NUMA workers, so every access takes the lock. */
+typedef struct __coverage {
+	const char *path;
+	char profile[ROWMAP_PROFILE_LEN];
+	unsigned nbanks, nrows;
+	uint64_t activations, rounds;
+	unsigned blast_radius;
+	unsigned npatterns;
+	uint8_t patterns[COVERAGE_MAX_PATTERNS][2];	// agg, victim
+	uint64_t rows[COVERAGE_MAX_SLOTS][COVERAGE_MAX_PATTERNS][MAX_CONTROLLED_BANKS];
+	uint64_t ncovered;
+	uint64_t nloaded;					// of ncovered, from the file
+	uint64_t nlost;						// completed but outside the table, not recorded
+	uint64_t last_flush_ns;
+	pthread_mutex_t lock;
+} coverage_t;
+
+void coverage_init(coverage_t *cov, const char *path, const hammer_ctx_t *ctx);
+int coverage_load(coverage_t *cov);
+int coverage_save(coverage_t *cov);
+int coverage_done(coverage_t *cov, const hammer_ctx_t *ctx, const hammer_job_t *job);
+void coverage_mark(coverage_t *cov, const hammer_ctx_t *ctx, const hammer_result_t *result);
+
+#endif
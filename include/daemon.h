@@ -0,0 +1,12 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "libhammer.h"
+
+#define DAEMON_BACKLOG 8
+#define DAEMON_LINE_MAX 256
+#define DAEMON_DEFAULT_PATH "/tmp/ddr3.sock"
+
+int daemon_run(hammer_ctx_t *ctx, const char *path, unsigned first_slot, unsigned nbuffers);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef EDAC_H
+#define EDAC_H
+
+#include <inttypes.h>
+
+#define EDAC_DEFAULT_ROOT "/sys/devices/system/edac"
+#define EDAC_MAX_MCS 16
+#define EDAC_PATH_LEN 256
+
+/* Memory controllers found under <root>/mc/mc*. On ECC machines a
+   flip gets corrected before the victim scan can see it, the only
+   trace is the controller's corrected error (CE) counter. */
+typedef struct __edac {
+    char root[EDAC_PATH_LEN];
+    unsigned nmcs;
+    int mc_ids[EDAC_MAX_MCS];
+} edac_t;
+
+typedef struct __edac_counts {
+    uint64_t ce[EDAC_MAX_MCS];
+    uint64_t ue[EDAC_MAX_MCS];
+} edac_counts_t;
+
+/* after - before, summed and per controller */
+typedef struct __edac_delta {
+    uint64_t ce;
+    uint64_t ue;
+    int mc;                             // first controller which moved, -1 if none
+} edac_delta_t;
+
+int edac_open(edac_t *edac, const char *root);
+int edac_snapshot(edac_t *edac, edac_counts_t *counts);
+void edac_delta(edac_t *edac, const edac_counts_t *before, const edac_counts_t *after, edac_delta_t *delta);
+
+#endif
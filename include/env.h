@@ -0,0 +1,31 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <sched.h>
+#include <inttypes.h>
+
+#define ENV_SYSFS_CPUS "/sys/devices/system/cpu"
+#define ENV_GOVERNOR_LEN 32
+
+#define ENV_NO_CPU (-1)
+#define ENV_AUTO_CPU (-2)				// Pick an isolated core, else the last allowed one
+
+/* Where and how the hammering thread runs. Read back
+   after pinning so the run header shows what we got. */
+typedef struct __exec_env {
+    int cpu;                            // pinned CPU or ENV_NO_CPU
+    uint8_t isolated;                   // cpu is in isolcpus
+    unsigned nisolated;
+    int fifo_prio;                      // SCHED_FIFO priority, 0 if SCHED_OTHER
+    char governor[ENV_GOVERNOR_LEN];    // cpufreq governor of cpu, "" if none
+    unsigned long cur_khz, min_khz, max_khz;
+    int smt_active;                     // -1 unknown
+    int sibling;                        // online SMT sibling of cpu, -1 if none
+} exec_env_t;
+
+int env_pick_cpu(const cpu_set_t *allowed);
+int env_pin_cpu(int cpu);
+int env_set_fifo(int prio);
+void env_probe(exec_env_t *env, int cpu);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef FLIPMAP_H
+#define FLIPMAP_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/* Roaring-style set of flipped bits. A bit is addressed by its index
+   addr * 8 + bit; the upper 48 bits select a container (8KB of memory,
+   one row), the lower 16 bits are stored in it. Sparse containers are
+   sorted uint16 arrays, they turn into a 65536 bit bitmap once that is
+   smaller. Memory grows with the flips found, not the pool size. */
+
+#define FLIPMAP_CONTAINER_BITS 16
+#define FLIPMAP_BITMAP_WORDS ((1 << FLIPMAP_CONTAINER_BITS) / 64)
+#define FLIPMAP_ARRAY_MAX 4096				// 8KB as array == 8KB as bitmap
+
+typedef struct __flipmap_container {
+    uint64_t key;
+    uint32_t card;
+    uint32_t cap;                       // array capacity, 0 once a bitmap
+    void *data;                         // uint16_t[cap] or uint64_t[FLIPMAP_BITMAP_WORDS]
+} flipmap_container_t;
+
+typedef struct __flipmap_set {
+    flipmap_container_t *containers;    // sorted by key
+    uint32_t n;
+    uint32_t cap;
+} flipmap_set_t;
+
+/* One set per flip direction (index 0: 0 -> 1, 1: 1 -> 0) */
+typedef struct __flipmap {
+    flipmap_set_t dir[2];
+} flipmap_t;
+
+typedef void (*flipmap_cb)(uintptr_t addr, unsigned bit, int direction, void *arg);
+
+void flipmap_init(flipmap_t *fm);
+void flipmap_free(flipmap_t *fm);
+int flipmap_add(flipmap_t *fm, uintptr_t addr, unsigned bit, int direction);
+int flipmap_add_byte(flipmap_t *fm, uintptr_t addr, uint8_t expected, uint8_t observed);
+int flipmap_contains(flipmap_t *fm, uintptr_t addr, unsigned bit, int direction);
+uint8_t flipmap_byte(flipmap_t *fm, uintptr_t addr, int direction);
+uint64_t flipmap_count(flipmap_t *fm, int direction);
+int flipmap_merge(flipmap_t *dst, flipmap_t *src);
+void flipmap_foreach(flipmap_t *fm, flipmap_cb cb, void *arg);
+size_t flipmap_bytes(flipmap_t *fm);
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef LIBHAMMER_H
+#define LIBHAMMER_H
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "util.h"
+#include "hammer.h"
+#include "rowmap.h"
+#include "perf.h"
+#include "numa.h"
+#include "timing.h"
+#include "env.h"
+#include "flipmap.h"
+#include "edac.h"
+#include "load.h"
+#include "stats.h"
+
+#define HAMMER_MAX_BUFFERS 64
+#define HAMMER_MAX_FLIPS 64					// Flipped bytes recorded per result
+#define HAMMER_ROW_MAP (-1)					// Aggressors come from the row map
+#define HAMMER_SMAPS_PATH "/proc/self/smaps"
+#define HAMMER_MAX_SETS 256					// Bank sets hammer_cluster_banks() can find
+#define HAMMER_ROWS_PER_BUFFER (BUFFER_SIZE / ROW_SIZE)
+#define HAMMER_MAX_RADIUS 8					// Rows around the aggressors blast scanning reaches
+#define HAMMER_MAX_BLAST (2 + 4 * HAMMER_MAX_RADIUS)
+#define HAMMER_CACHE_SAMPLES 64				// Hit/miss timings calibrating the probe threshold
+
+/* Row payload state, 0..255 means every payload byte holds that value */
+#define HAMMER_ROW_DIRTY	(-1)				// Written or flipped, needs a rewrite
+#define HAMMER_ROW_UNKNOWN	(-2)				// Next to a hammered row, check before use
+
+/* Non-fatal problems hammer_ctx_init()/hammer_ctx_map_buffers() ran into */
+#define HAMMER_WARN_PIN		(1 << 0)			// Could not pin to the NUMA node
+#define HAMMER_WARN_MBIND	(1 << 1)			// A buffer could not be bound to the node
+#define HAMMER_WARN_PERF	(1 << 2)			// perf_event_open failed, counters off
+#define HAMMER_WARN_NO_IMC	(1 << 3)			// No uncore IMC counters, ACT/s is nominal
+#define HAMMER_WARN_ROWMAP	(1 << 4)			// Row map file unusable, logical adjacency
+#define HAMMER_WARN_TSC		(1 << 5)			// TSC is not invariant
+#define HAMMER_WARN_CPU		(1 << 6)			// Could not pin to the chosen CPU
+#define HAMMER_WARN_FIFO	(1 << 7)			// SCHED_FIFO refused (needs CAP_SYS_NICE)
+#define HAMMER_WARN_GOVERNOR	(1 << 8)			// cpufreq governor is not "performance"
+#define HAMMER_WARN_SMT		(1 << 9)			// SMT sibling of the CPU is online
+#define HAMMER_WARN_FLIPMAP	(1 << 10)			// Flip map ran out of memory, pool totals are short
+#define HAMMER_WARN_EDAC	(1 << 11)			// No EDAC controllers under the given sysfs root
+
+#define PREV_ROW (-1)
+#define NEXT_ROW (1)
+
+/* ROW ADJACENCY INFERENCE */
+#define ROWMAP_DUMMIES 3						// Far rows each aggressor is hammered against
+#define ROWMAP_DEFAULT_PATH "rowmap.txt"
+
+typedef struct _config {
+	uint64_t num_row_activations;
+	uint64_t hammering_rounds;
+	uint64_t bank_n;
+	uint64_t random_pairs;
+	uint64_t interleave_banks;
+	int numa_node;
+	int cpu;							// ENV_NO_CPU, ENV_AUTO_CPU or a CPU number
+	int fifo_prio;						// 0 keeps SCHED_OTHER
+	uint8_t numa_all;
+	uint8_t perf;
+	uint8_t infer_rows;
+	char *row_map_path;
+	char *dram_gen;
+	char *daemon_path;
+	char *campaign_path;
+	char *edac_root;					// NULL: EDAC_DEFAULT_ROOT if present
+	double time_budget;					// seconds, 0 runs without a deadline
+	char *history_path;
+	uint64_t cluster_samples;				// bank clustering mode, 0 off
+	unsigned blast_radius;					// rows around the aggressors to scan, 0: victim only
+	char *load_spec;						// background traffic (see load_parse()), NULL: none
+	uint8_t validate;						// what a profile failing the startup check leads to
+	char *coverage_path;					// triplets a sweep got through, NULL: not kept
+	char *metrics_path;					// Prometheus textfile, NULL: not written
+	char *sample_spec;					// quick screen (see sample_parse()), NULL: off
+	uint64_t sample_seed;				// order of the sampled units, 0: from the clock
+        uint8_t random_mode;
+	uint8_t print_rows;
+	uint8_t all_banks;
+        uint8_t verbose;
+        uint8_t flip;
+}hammer_config_t;
+
+/* One triplet to hammer. The aggressors are the physical neighbours
+   of victim_row unless agg_rows[] name them explicitly. activations
+   and rounds of 0 take the context's configuration. */
+typedef struct __hammer_job {
+	unsigned buffer;
+	unsigned bank;
+	unsigned victim_row;
+	int agg_rows[2];
+	uint8_t agg_pattern;
+	uint8_t victim_pattern;
+	uint64_t activations;
+	uint64_t rounds;
+} hammer_job_t;
+
+typedef struct __hammer_flip {
+	uintptr_t addr;
+	uint8_t expected;
+	uint8_t observed;
+	uint8_t distance;						// rows from the nearest aggressor, 1 for the victim
+} hammer_flip_t;
+
+/* A row scanned besides the victim (blast_radius). Aggressors
+   are at distance 0 and keep the aggressor pattern. */
+typedef struct __hammer_blast_row {
+	uint8_t *row;
+	unsigned logical;
+	uint8_t pattern;
+	uint8_t distance;
+	uint64_t flips;
+} hammer_blast_row_t;
+
+typedef struct __hammer_result {
+	int status;							// 0 or -errno
+	unsigned buffer;
+	unsigned bank;
+	unsigned rows[3];						// agg1, victim, agg2 (logical)
+	uint8_t *agg1, *victim, *agg2;
+	uint8_t agg_pattern;
+	uint8_t victim_pattern;
+	uint64_t flips;							// flipped bits in the victim
+	uint64_t flips_0_to_1;
+	uint64_t flips_1_to_0;
+	uint64_t activations;					// issued to this bank
+	uint64_t elapsed_ns;
+	double acts_per_sec;
+	uint8_t interleaved;					// number of banks sharing the stream
+	uint8_t have_perf;
+	perf_sample_t perf;
+	uint8_t have_edac;
+	edac_delta_t edac;						// ECC errors while hammering, shared by the stream
+	double load_mbps;						// background traffic while hammering, 0 without load
+	unsigned nblast;
+	hammer_blast_row_t blast[HAMMER_MAX_BLAST];
+	uint64_t flips_at[HAMMER_MAX_RADIUS + 1];		// flipped bits by distance, the victim's included
+	unsigned cached;						// scanned rows still in the cache after hammering
+	unsigned nrecorded;
+	hammer_flip_t recorded[HAMMER_MAX_FLIPS];
+} hammer_result_t;
+
+/* Same-bank address sets found by hammer_cluster_banks(). Set i
+   is addrs[offsets[i]] .. addrs[offsets[i + 1] - 1]. */
+typedef struct __hammer_bank_sets {
+	uint8_t **addrs;
+	size_t offsets[HAMMER_MAX_SETS + 1];
+	unsigned nsets;
+	size_t nsamples;
+	size_t unassigned;						// samples left in no set
+	uint64_t measurements;					// timed address pairs
+	double threshold_ns;					// row conflict latency, calibrated on the first pivot
+} hammer_bank_sets_t;
+
+/* Timing spot check of the profile, see hammer_validate_profile() */
+typedef struct __hammer_validation {
+	unsigned npairs;
+	unsigned agree;							// pairs timed as the profile predicts
+	unsigned false_hits;					// predicted conflicts timed as hits
+	unsigned false_conflicts;				// predicted hits timed as conflicts
+	double hit_ns;							// same-row latency
+	double threshold_ns;
+	uint64_t elapsed_ns;
+} hammer_validation_t;
+
+typedef struct __hammer_ctx hammer_ctx_t;
+typedef void (*hammer_result_cb)(hammer_ctx_t *ctx, const hammer_result_t *result, void *arg);
+
+/* Everything a run needs: configuration, geometry, row adjacency,
+   counters and the buffer pool. One context per thread, contexts
+   don't share any mutable state. */
+struct __hammer_ctx {
+	hammer_config_t conf;
+	dram_profile_t dram;
+	row_map_t row_map;
+	numa_topology_t numa_topo;
+	exec_env_t env;
+	edac_t edac;							// nmcs == 0: no ECC counters
+	perf_counters_t *perf;
+	uint8_t *buffers[HAMMER_MAX_BUFFERS];
+	unsigned nbuffers;
+	unsigned seed;
+	unsigned warnings;
+	flipmap_t flips;						// every flip found in the pool
+	load_t *load;							// background traffic, NULL if none
+	stats_t *stats;							// live statistics segment, NULL if none
+	int16_t row_state[HAMMER_MAX_BUFFERS][HAMMER_ROWS_PER_BUFFER];	// per ROW_SIZE chunk
+	uint64_t rows_written, rows_checked, rows_reused;
+	uint64_t rows_probed, rows_cached;		// rows timed before a scan, of which cached
+	uint64_t cache_hit_cycles;				// probes below were served from cache, 0: no signal
+	uint8_t cache_calibrated;
+	hammer_result_cb on_result;
+	void *cb_arg;
+};
+
+/* Context */
+int hammer_ctx_init(hammer_ctx_t *ctx, const hammer_config_t *conf);
+void hammer_ctx_destroy(hammer_ctx_t *ctx);
+void hammer_ctx_set_callback(hammer_ctx_t *ctx, hammer_result_cb cb, void *arg);
+
+/* Buffer pool */
+int hammer_ctx_map_buffers(hammer_ctx_t *ctx, unsigned first_slot, unsigned nbuffers);
+void hammer_ctx_unmap_buffers(hammer_ctx_t *ctx);
+uint8_t *hammer_ctx_buffer(hammer_ctx_t *ctx, unsigned idx);
+int hammer_buffer_is_huge(uint8_t *buf);
+void hammer_fill_buffer(hammer_ctx_t *ctx, uint8_t *buf, uint8_t value);
+void hammer_row_dirty(hammer_ctx_t *ctx, uint8_t *row);
+
+/* Geometry */
+void hammer_bank_rows(hammer_ctx_t *ctx, uint8_t *buf, unsigned bank, uint8_t **addrs);
+uintptr_t hammer_row_align(hammer_ctx_t *ctx, uint8_t *buf, uint8_t *addr);
+uintptr_t hammer_adjacent_row(hammer_ctx_t *ctx, uint8_t *buf, uint8_t *addr, int placement);
+
+/* Jobs */
+size_t hammer_bank_jobs(hammer_ctx_t *ctx, unsigned buffer, unsigned bank, hammer_job_t *jobs, size_t max);
+void hammer_random_job(hammer_ctx_t *ctx, unsigned buffer, hammer_job_t *job);
+int hammer_run_jobs(hammer_ctx_t *ctx, const hammer_job_t *jobs, size_t njobs, hammer_result_t *results);
+int hammer_scan_victim(hammer_result_t *result, flipmap_t *fm);
+void hammer_flush_rows(uint8_t **rows, unsigned nrows);
+unsigned hammer_uncache_rows(hammer_ctx_t *ctx, uint8_t **rows, unsigned nrows);
+
+/* Low level */
+int hammer_pair(hammer_ctx_t *ctx, volatile uint8_t *a, volatile uint8_t *b, uint64_t activations, perf_sample_t *sample);
+double hammer_reference_rate(hammer_ctx_t *ctx, unsigned buffer);
+int hammer_infer_row_map(hammer_ctx_t *ctx, unsigned buffer, int bank);
+
+/* DRAM function discovery (see discover.c) */
+uint64_t *hammer_calc_functions(uint8_t **conflict_addrs, size_t conflict_addrs_size, uint8_t *base_addr);
+uint64_t *hammer_discover_functions(hammer_ctx_t *ctx, unsigned buffer);
+uint64_t hammer_discover_row_mask(hammer_ctx_t *ctx, unsigned buffer, const dram_profile_t *dram);
+int hammer_cluster_banks(hammer_ctx_t *ctx, unsigned buffer, size_t nsamples, hammer_bank_sets_t *sets);
+void hammer_bank_sets_free(hammer_bank_sets_t *sets);
+uint64_t *hammer_solve_functions(const hammer_bank_sets_t *sets);
+int hammer_validate_profile(hammer_ctx_t *ctx, unsigned buffer, hammer_validation_t *v);
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef LOAD_H
+#define LOAD_H
+
+#include <pthread.h>
+#include <inttypes.h>
+#include "numa.h"
+
+#define LOAD_MAX_THREADS 64
+#define LOAD_BUFFER_SIZE (64UL << 20)		// per thread, well past the LLC
+#define LOAD_STEP_LINES 1024				// cache lines between two throttle checks
+#define LOAD_LINE_SIZE 64
+
+#define LOAD_STREAM 0
+#define LOAD_RANDOM 1
+
+/* Background memory traffic next to the hammer kernels. Every
+   thread dirties cache lines of its own buffer, sequentially or at
+   random, and sleeps when it runs ahead of its share of mbps. */
+typedef struct __load_thread {
+    pthread_t tid;
+    struct __load *load;
+    uint8_t *buf;
+    uint64_t seed;
+    uint64_t bytes;                     // moved so far, written by the thread only
+} load_thread_t;
+
+typedef struct __load {
+    unsigned nthreads;
+    double mbps;                        // all threads together, 0 unthrottled
+    int pattern;                        // LOAD_STREAM or LOAD_RANDOM
+    int node;                           // buffers and threads, NUMA_NO_NODE: kernel default
+    int avoid_cpu;                      // the hammering CPU, -1 if not pinned
+    numa_topology_t *topo;
+    volatile int stop;
+    unsigned nstarted;
+    load_thread_t threads[LOAD_MAX_THREADS];
+} load_t;
+
+int load_parse(load_t *load, const char *spec);
+int load_start(load_t *load, numa_topology_t *topo, int avoid_cpu);
+void load_stop(load_t *load);
+uint64_t load_bytes(load_t *load);
+
+#endif
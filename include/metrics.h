@@ -0,0 +1,43 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include "libhammer.h"
+
+#define METRICS_INTERVAL_NS 5000000000ULL	// between two rewrites of the .prom file
+#define METRICS_PREFIX "rowhammer_"
+
+/* Phases of a run, time is accounted to the current one */
+#define METRICS_SETUP 0						// context, profile, buffers
+#define METRICS_CHECK 1						// profile check, discovery
+#define METRICS_SWEEP 2						// hammering and scanning
+#define METRICS_DONE 3
+#define METRICS_PHASES 4
+
+/* Counters for a node_exporter textfile collector, fed by the result
+   callback and the buffer setup. Shared by the NUMA workers. */
+typedef struct __metrics {
+	const char *path;
+	char profile[ROWMAP_PROFILE_LEN];
+	unsigned phase;
+	uint64_t phase_start_ns;
+	double phase_seconds[METRICS_PHASES];
+	uint64_t triplets;
+	uint64_t flips[MAX_CONTROLLED_BANKS][2];	// 0 -> 1, 1 -> 0
+	uint64_t activations;
+	uint64_t hammer_ns;
+	double acts_per_sec;					// of the last job, per bank
+	uint64_t buffers_mapped;
+	uint64_t buffers_huge;
+	uint64_t buffer_failures;
+	uint64_t last_write_ns;
+	pthread_mutex_t lock;
+} metrics_t;
+
+void metrics_init(metrics_t *m, const char *path);
+void metrics_phase(metrics_t *m, unsigned phase, const char *profile);
+void metrics_result(metrics_t *m, const hammer_result_t *result);
+void metrics_buffer(metrics_t *m, int mapped, int huge);
+int metrics_write(metrics_t *m);
+
+#endif
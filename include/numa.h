@@ -0,0 +1,32 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <sched.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+#define NUMA_MAX_NODES 64
+#define NUMA_SYSFS_NODES "/sys/devices/system/node"
+#define NUMA_SYSFS_CPUS "/sys/devices/system/cpu"
+
+/* From linux/mempolicy.h, no libnuma needed. */
+#define NUMA_MPOL_BIND 2
+#define NUMA_MPOL_MF_STRICT (1 << 0)
+#define NUMA_MPOL_MF_MOVE (1 << 1)
+
+#define NUMA_NO_NODE (-1)
+
+typedef struct __numa_topology {
+    unsigned nnodes;
+    int node_ids[NUMA_MAX_NODES];
+    int socket_ids[NUMA_MAX_NODES];
+    cpu_set_t cpus[NUMA_MAX_NODES];
+} numa_topology_t;
+
+int numa_parse_cpulist(const char *list, cpu_set_t *set);
+void numa_discover(numa_topology_t *topo);
+int numa_node_index(numa_topology_t *topo, int node);
+int numa_bind_buffer(void *addr, size_t len, int node);
+int numa_pin_thread(numa_topology_t *topo, int node);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <inttypes.h>
+
+#define PERF_MAX_IMC 16
+#define PERF_SYSFS_PMUS "/sys/bus/event_source/devices"
+
+typedef struct __perf_counters {
+    int llc_misses;
+    int l1d_loads;
+    int cycles;
+    int imc_cas[PERF_MAX_IMC];
+    int imc_act[PERF_MAX_IMC];
+    unsigned nimc_cas;
+    unsigned nimc_act;
+    uint64_t t_start;
+} perf_counters_t;
+
+typedef struct __perf_sample {
+    uint64_t llc_misses;
+    uint64_t l1d_loads;
+    uint64_t cycles;
+    uint64_t imc_cas;
+    uint64_t imc_act;
+    uint64_t elapsed_ns;
+    uint64_t iterations;
+    double misses_per_iter;
+    double acts_per_sec;
+    uint8_t imc_measured;           // acts_per_sec from IMC ACT count, else nominal
+} perf_sample_t;
+
+int perf_open(perf_counters_t *pc);
+void perf_close(perf_counters_t *pc);
+void perf_begin(perf_counters_t *pc, uint64_t now_ns);
+void perf_end(perf_counters_t *pc, uint64_t now_ns, uint64_t iterations, uint64_t nominal_acts, perf_sample_t *sample);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef ROWMAP_H
+#define ROWMAP_H
+
+#include <inttypes.h>
+
+#define ROWMAP_MAX_ROWS 64
+#define ROWMAP_NO_ROW (-1)
+#define ROWMAP_PROFILE_LEN 32
+
+/* Logical -> physical row adjacency. neighbours[r] holds the two
+   logical rows which are physically next to logical row r. */
+typedef struct __row_map {
+    char profile[ROWMAP_PROFILE_LEN];
+    unsigned nrows;
+    int16_t neighbours[ROWMAP_MAX_ROWS][2];
+    uint8_t inferred[ROWMAP_MAX_ROWS];
+} row_map_t;
+
+void rowmap_identity(row_map_t *map, const char *profile, unsigned nrows);
+unsigned rowmap_ninferred(row_map_t *map);
+int rowmap_aggressors(row_map_t *map, unsigned victim, unsigned *agg1, unsigned *agg2);
+void rowmap_from_evidence(row_map_t *map, uint64_t evidence[][ROWMAP_MAX_ROWS]);
+int rowmap_save(row_map_t *map, const char *path);
+int rowmap_load(row_map_t *map, const char *path, const char *profile, unsigned nrows);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "libhammer.h"
+
+#define SAMPLE_Z 1.96						// 95% confidence
+#define SAMPLE_MIN_UNITS 20					// before any early stop
+#define SAMPLE_REPORT_EVERY 25				// units between two progress lines
+
+#define SAMPLE_RUNNING 0
+#define SAMPLE_PASS 1						// upper bound below the threshold
+#define SAMPLE_FAIL 2						// lower bound above the threshold
+#define SAMPLE_PRECISE 3					// interval narrow enough, straddles the threshold
+#define SAMPLE_EXHAUSTED 4					// pool or unit cap used up, or interrupted
+
+/* Quick screen of a module: (buffer, bank, triplet) units drawn at
+   random without replacement, each hammered with the configured
+   activations and rounds. The fraction of units with at least one
+   flipped bit is estimated with a Wilson score interval. */
+typedef struct __sample {
+	double threshold;					// largest acceptable fraction of units with flips
+	double half_width;					// stop once the interval is this narrow
+	uint64_t max_units;					// 0: the whole pool
+	uint64_t seed;
+	uint64_t units;
+	uint64_t vulnerable;				// units with flipped bits
+	uint64_t flips;
+	uint64_t activations;
+	uint64_t elapsed_ns;
+	double lower, upper;
+	int verdict;
+} sample_t;
+
+int sample_parse(sample_t *sample, const char *spec);
+int sample_run(hammer_ctx_t *ctx, sample_t *sample, unsigned first_slot, unsigned nbuffers);
+const char *sample_verdict(int verdict);
+
+#endif
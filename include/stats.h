@@ -0,0 +1,45 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#define STATS_MAGIC 0x52484d53				// "RHMS"
+#define STATS_VERSION 1
+#define STATS_NAME_FMT "/rowhammer.%d"		// POSIX shm name, by pid
+
+#define STATS_SETUP 0
+#define STATS_CHECK 1						// profile check, discovery
+#define STATS_SWEEP 2						// between two jobs
+#define STATS_HAMMER 3
+#define STATS_SCAN 4
+#define STATS_DONE 5
+
+/* Live statistics of a run in a POSIX shared memory segment. The
+   writer updates fields with relaxed atomics and never waits for
+   readers, so a reader may see a job's fields from two jobs. */
+typedef struct __stats {
+    uint32_t magic;
+    uint32_t version;
+    int32_t pid;
+    uint32_t phase;
+    uint32_t buffer;                    // of the last job started
+    uint32_t bank;
+    uint32_t row;                       // victim, logical
+    uint32_t pad;
+    uint64_t started_ns;                // CLOCK_REALTIME
+    uint64_t updated_ns;
+    uint64_t triplets;
+    uint64_t flips;
+    uint64_t activations;
+    uint64_t acts_per_sec;              // of the last job, per bank
+} stats_t;
+
+stats_t *stats_create(void);
+void stats_destroy(stats_t *stats);
+void stats_phase(stats_t *stats, unsigned phase);
+void stats_job(stats_t *stats, unsigned buffer, unsigned bank, unsigned row);
+void stats_result(stats_t *stats, uint64_t flips, uint64_t activations, uint64_t acts_per_sec);
+int stats_print(pid_t pid);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <time.h>
+#include <inttypes.h>
+#include "asm.h"
+
+#define TSC_CALIBRATION_NS 20000000ULL     // 20ms per calibration window
+#define TSC_CALIBRATION_RUNS 5
+#define TSC_OVERHEAD_SAMPLES 10001
+
+typedef struct __tsc_calibration {
+    uint8_t invariant;
+    double ticks_per_ns;
+    uint64_t overhead;      // cycles of an empty tsc_begin()/tsc_end() pair
+} tsc_calibration_t;
+
+extern tsc_calibration_t tsc_cal;
+
+static __always_inline uint64_t __clock_monotonic_ns(void)
+{
+    struct timespec now_ts;
+    clock_gettime(CLOCK_MONOTONIC, &now_ts);
+    return (now_ts.tv_sec * 1000000000ULL + now_ts.tv_nsec);
+}
+
+/* Serialized TSC reads bracketing a measured region. */
+static __always_inline uint64_t tsc_begin(void)
+{
+    uint64_t t;
+
+    lfence();
+    t = rdtscp();
+    lfence();
+    return t;
+}
+
+static __always_inline uint64_t tsc_end(void)
+{
+    uint64_t t;
+
+    t = rdtscp();
+    lfence();
+    return t;
+}
+
+/* Cycles between two reads minus the measurement overhead. */
+static __always_inline uint64_t tsc_elapsed(uint64_t start, uint64_t end)
+{
+    uint64_t delta;
+
+    delta = end - start;
+    return delta > tsc_cal.overhead ? delta - tsc_cal.overhead : 0;
+}
+
+static __always_inline double cycles_to_ns(uint64_t cycles)
+{
+    return tsc_cal.ticks_per_ns > 0 ? cycles / tsc_cal.ticks_per_ns : (double) cycles;
+}
+
+/* Monotonic nanoseconds, from the TSC when it is invariant. */
+static __always_inline uint64_t timing_now_ns(void)
+{
+    if(tsc_cal.invariant && tsc_cal.ticks_per_ns > 0) {
+        return (uint64_t) (rdtscp() / tsc_cal.ticks_per_ns);
+    }
+    return __clock_monotonic_ns();
+}
+
+int timing_init(void);
+
+#endif
@@ -1,9 +1,15 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stdio.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #define BUFFER_SIZE (1ULL << 21)
+#define PAGE_SIZE 4096
+#define ROW_SIZE (PAGE_SIZE * 2)
+#define ENTROPY_PADDING_SIZE sizeof(uint64_t)
+#define CACHE_LINE_SIZE 64
 #define ZERO_TO_ONE 1
 #define ONE_TO_ZERO 2
 #define NUM_EXPLOITABLE_OPCODES 29
@@ -17,17 +23,6 @@
 #define pr_debug(...) \
         fprintf(stderr, __VA_ARGS__); fflush(stderr)
 
-typedef struct _config {
-	uint64_t num_row_activations;
-	uint64_t hammering_rounds;
-	uint64_t bank_n;
-	uint64_t random_pairs;
-        uint8_t random_mode;
-	uint8_t print_rows;
-	uint8_t all_banks;
-        uint8_t verbose;
-        uint8_t flip;
-}hammer_config_t;
 
 typedef struct __vuln_opcodes {
         unsigned file_offset;
@@ -40,44 +35,35 @@ typedef struct __template {
         vuln_opcode op;
 } template_t;
 
-vuln_opcode opcodes[NUM_EXPLOITABLE_OPCODES] = {
-        {0x8c1c, 4, ONE_TO_ZERO},
-        {0x8c32, 3, ONE_TO_ZERO},
-        {0x8d4e, 0, ZERO_TO_ONE},
-        {0x8d4f, 0, ONE_TO_ZERO},
-        {0x8d59, 0, ZERO_TO_ONE},
-        {0x8d59, 1, ZERO_TO_ONE},
-        {0x8d59, 2, ZERO_TO_ONE},
-        {0x8d59, 3, ONE_TO_ZERO},
-        {0x8d59, 6, ONE_TO_ZERO},
-        {0x8d5a, 5, ZERO_TO_ONE},
-        {0x8d5d, 7, ZERO_TO_ONE},
-        {0x8d5e, 0, ZERO_TO_ONE},
-        {0x8d5f, 0, ONE_TO_ZERO},
-        {0x8dbd, 3, ZERO_TO_ONE},
-        {0x8dbd, 7, ONE_TO_ZERO},
-        {0x8dbf, 0, ONE_TO_ZERO},
-        {0x8dbf, 3, ZERO_TO_ONE},
-        {0x8dc4, 3, ONE_TO_ZERO},
-        {0x8dc5, 1, ZERO_TO_ONE},
-        {0x8dc5, 2, ZERO_TO_ONE},
-        {0x8dc9, 3, ZERO_TO_ONE},
-        {0x8dc9, 4, ZERO_TO_ONE},
-        {0x8dca, 7, ONE_TO_ZERO},
-        {0x8dcb, 3, ZERO_TO_ONE},
-        {0x8dcf, 0, ZERO_TO_ONE},
-        {0x8dcf, 3, ZERO_TO_ONE},
-        {0x8dd0, 2, ONE_TO_ZERO},
-        {0x8dd1, 0, ONE_TO_ZERO},
-        {0x8e23, 6, ONE_TO_ZERO},
-};
+extern vuln_opcode opcodes[NUM_EXPLOITABLE_OPCODES];
 
-/* Safely exit by unmapping
-   the buffer. Bit hackish
-   for now. */
-void exit_safely(uint8_t *buffer){
-    assert(munmap(buffer, BUFFER_SIZE) == 0);
-    exit(EXIT_FAILURE);
+/* xorshift64, x must not be 0 */
+static __always_inline uint64_t xorshift64(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return *x;
+}
+
+/* write fills <path>.tmp which is then renamed to path, readers
+   and a crash mid-save never see a half written file. Returns
+   0 or -errno. */
+static inline int save_atomic(const char *path, void (*write)(FILE *fp, void *arg), void *arg)
+{
+	char tmp[512];
+	FILE *fp;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if(fp == NULL) {
+		return -errno;
+	}
+	write(fp, arg);
+	if(fclose(fp) || rename(tmp, path)) {
+		return -errno;
+	}
+	return 0;
 }
 
 #endif
@@ -0,0 +1,273 @@
+#include <math.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include "budget.h"
+
+/* History file, one line per bank/row that was ever hammered:
+ *
+ *   profile <name> <banks> <rows>
+ *   <bank> <row> <attempts> <flipped bits> <ecc errors>
+ *
+ * Rows are logical positions inside a buffer. Buffers land on other
+ * physical rows every run, so the history is a prior on where a
+ * module's weak banks and row positions are, not a list of cells. */
+
+typedef struct __budget_job {
+	hammer_job_t job;
+	unsigned passes;					// times hammered in this run
+} budget_job_t;
+
+static volatile sig_atomic_t budget_stop;
+
+static void budget_signal(int sig)
+{
+	(void) sig;
+	budget_stop = 1;
+}
+
+/* Returns 0, -ENOENT without a file, -EINVAL if it is malformed
+   or belongs to another profile. */
+int budget_load_history(budget_t *budget, const char *path, const dram_profile_t *dram)
+{
+	char name[ROWMAP_PROFILE_LEN];
+	unsigned nbanks, nrows, bank, row;
+	uint64_t attempts, flips, ecc;
+	FILE *fp;
+	int rv;
+
+	budget->history_path = path;
+	fp = fopen(path, "r");
+	if(fp == NULL) {
+		return -ENOENT;
+	}
+
+	rv = 0;
+	if(fscanf(fp, "profile %31s %u %u", name, &nbanks, &nrows) != 3 || strcmp(name, dram->name) ||
+	   nbanks != dram->nbanks || nrows != dram->nrows) {
+		rv = -EINVAL;
+		goto out;
+	}
+	while((rv = fscanf(fp, "%u %u %" SCNu64 " %" SCNu64 " %" SCNu64, &bank, &row, &attempts, &flips, &ecc)) == 5) {
+		if(bank >= MAX_CONTROLLED_BANKS || row >= MAX_CONTROLLED_ROWS) {
+			rv = -EINVAL;
+			goto out;
+		}
+		budget->rows[bank][row].attempts += attempts;
+		budget->rows[bank][row].flips += flips;
+		budget->rows[bank][row].ecc += ecc;
+		budget->nhistory += attempts;
+	}
+	rv = rv == EOF ? 0 : -EINVAL;
+
+out:
+	fclose(fp);
+	return rv;
+}
+
+struct __budget_file {
+	budget_t *budget;
+	const dram_profile_t *dram;
+};
+
+static void __budget_write(FILE *fp, void *arg)
+{
+	struct __budget_file *f = arg;
+	unsigned b, r;
+
+	fprintf(fp, "profile %s %u %u\n", f->dram->name, f->dram->nbanks, f->dram->nrows);
+	for(b = 0; b < f->dram->nbanks && b < MAX_CONTROLLED_BANKS; ++b) {
+		for(r = 0; r < f->dram->nrows && r < MAX_CONTROLLED_ROWS; ++r) {
+			if(f->budget->rows[b][r].attempts) {
+				fprintf(fp, "%u %u %lu %lu %lu\n", b, r, f->budget->rows[b][r].attempts,
+						f->budget->rows[b][r].flips, f->budget->rows[b][r].ecc);
+			}
+		}
+	}
+}
+
+/* Write to <path>.tmp and rename, an interrupted save
+   leaves the previous history in place. */
+int budget_save_history(budget_t *budget, const dram_profile_t *dram)
+{
+	struct __budget_file f = {budget, dram};
+
+	if(budget->history_path == NULL) {
+		return 0;
+	}
+	return save_atomic(budget->history_path, __budget_write, &f);
+}
+
+/* Job of the current pass with the best expected yield. A row's mean
+   is shrunk towards its bank's mean, which is shrunk towards the
+   pool's, so untried rows of a weak bank rank high. A bonus for rows
+   tried less often keeps one lucky row from taking the whole window.
+   All triplets cost the same, so yield per job is yield per second. */
+static budget_job_t *budget_pick(hammer_ctx_t *ctx, budget_t *budget, budget_job_t *jobs, size_t njobs, unsigned pass)
+{
+	double bank_mean[MAX_CONTROLLED_BANKS], pool_mean, row_mean, score, best_score;
+	uint64_t bank_attempts, bank_yield, attempts, yield;
+	budget_stat_t *stat;
+	budget_job_t *best;
+	unsigned b, r;
+	size_t i;
+
+	attempts = yield = 0;
+	for(b = 0; b < ctx->dram.nbanks && b < MAX_CONTROLLED_BANKS; ++b) {
+		for(r = 0; r < ctx->dram.nrows && r < MAX_CONTROLLED_ROWS; ++r) {
+			attempts += budget->rows[b][r].attempts;
+			yield += budget->rows[b][r].flips + budget->rows[b][r].ecc;
+		}
+	}
+	pool_mean = attempts ? (double) yield / attempts : 0;
+
+	for(b = 0; b < ctx->dram.nbanks && b < MAX_CONTROLLED_BANKS; ++b) {
+		bank_attempts = bank_yield = 0;
+		for(r = 0; r < ctx->dram.nrows && r < MAX_CONTROLLED_ROWS; ++r) {
+			bank_attempts += budget->rows[b][r].attempts;
+			bank_yield += budget->rows[b][r].flips + budget->rows[b][r].ecc;
+		}
+		bank_mean[b] = (bank_yield + pool_mean * BUDGET_PRIOR_WEIGHT) / (bank_attempts + BUDGET_PRIOR_WEIGHT);
+	}
+
+	best = NULL;
+	best_score = -1;
+	for(i = 0; i < njobs; ++i) {
+		if(jobs[i].passes != pass) {
+			continue;
+		}
+		stat = &budget->rows[jobs[i].job.bank][jobs[i].job.victim_row];
+		row_mean = (stat->flips + stat->ecc + bank_mean[jobs[i].job.bank] * BUDGET_PRIOR_WEIGHT) /
+				   (stat->attempts + BUDGET_PRIOR_WEIGHT);
+		score = row_mean + BUDGET_EXPLORE * (pool_mean + 1) * sqrt(log(attempts + 1) / (stat->attempts + 1));
+		if(score > best_score) {
+			best = &jobs[i];
+			best_score = score;
+		}
+	}
+	return best;
+}
+
+static void budget_summary(hammer_ctx_t *ctx, budget_t *budget, budget_stat_t *run, uint64_t elapsed_ns)
+{
+	uint64_t attempts, flips, ecc;
+	unsigned b;
+
+	attempts = flips = ecc = 0;
+	for(b = 0; b < ctx->dram.nbanks; ++b) {
+		attempts += run[b].attempts;
+		flips += run[b].flips;
+		ecc += run[b].ecc;
+		if(run[b].attempts) {
+			pr_info("[BUDGET] bank %u: %lu triplets, %lu flipped bits, %lu ECC errors\n",
+					b, run[b].attempts, run[b].flips, run[b].ecc);
+		}
+	}
+	pr_info("[BUDGET] %lu triplets in %0.1f of %0.1f s: %lu flipped bits, %lu ECC errors (%0.2f per minute)\n",
+			attempts, elapsed_ns / 1e9, budget->budget_ns / 1e9, flips, ecc,
+			elapsed_ns ? (flips + ecc) * 60e9 / elapsed_ns : 0);
+	fflush(stdout);
+}
+
+/* Hammer the triplets of nbuffers buffers, best expected yield first,
+   until budget_ns is used up or a signal arrives. A job is only
+   started if its estimated cost still fits in the window. Every
+   triplet is hammered once before any is hammered again. */
+int budget_run(hammer_ctx_t *ctx, budget_t *budget, unsigned first_slot, unsigned nbuffers)
+{
+	budget_stat_t run[MAX_CONTROLLED_BANKS];
+	struct sigaction sa, old_int, old_term;
+	hammer_job_t bank_jobs[MAX_CONTROLLED_ROWS];
+	hammer_result_t result;
+	budget_job_t *jobs, *job;
+	uint64_t t_start, t_end, t_job, est_ns, yield;
+	unsigned buf, bank, pass, done;
+	size_t njobs, n, k;
+	int rv;
+
+	memset(run, 0, sizeof(run));
+	jobs = calloc((size_t) nbuffers * ctx->dram.nbanks * MAX_CONTROLLED_ROWS, sizeof(budget_job_t));
+	if(jobs == NULL) {
+		return -ENOMEM;
+	}
+	if((rv = hammer_ctx_map_buffers(ctx, first_slot, nbuffers))) {
+		goto out;
+	}
+
+	njobs = 0;
+	for(buf = 0; buf < nbuffers; ++buf) {
+		for(bank = 0; bank < ctx->dram.nbanks && bank < MAX_CONTROLLED_BANKS; ++bank) {
+			n = hammer_bank_jobs(ctx, buf, bank, bank_jobs, MAX_CONTROLLED_ROWS);
+			for(k = 0; k < n; ++k) {
+				jobs[njobs++].job = bank_jobs[k];
+			}
+		}
+	}
+	pr_info("[BUDGET] %lu triplets in %u buffers, %0.1f s, %lu attempts of history\n",
+			njobs, nbuffers, budget->budget_ns / 1e9, budget->nhistory);
+	if(njobs == 0) {
+		rv = -EINVAL;
+		goto out;
+	}
+
+	budget_stop = 0;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = budget_signal;
+	sigaction(SIGINT, &sa, &old_int);
+	sigaction(SIGTERM, &sa, &old_term);
+
+	t_start = timing_now_ns();
+	t_end = t_start + budget->budget_ns;
+	est_ns = 0;
+	pass = 0;
+	done = 0;
+	while(!budget_stop) {
+		if((job = budget_pick(ctx, budget, jobs, njobs, pass)) == NULL) {
+			pass++;
+			continue;
+		}
+		/* The first job has no estimate yet, it always runs */
+		t_job = timing_now_ns();
+		if(t_job + est_ns > t_end) {
+			break;
+		}
+
+		hammer_run_jobs(ctx, &job->job, 1, &result);
+		job->passes++;
+		t_job = timing_now_ns() - t_job;
+		est_ns = est_ns ? (3 * est_ns + t_job) / 4 : t_job;
+		if(result.status) {
+			continue;
+		}
+
+		yield = result.have_edac ? result.edac.ce + result.edac.ue : 0;
+		budget->rows[job->job.bank][job->job.victim_row].attempts++;
+		budget->rows[job->job.bank][job->job.victim_row].flips += result.flips;
+		budget->rows[job->job.bank][job->job.victim_row].ecc += yield;
+		run[job->job.bank].attempts++;
+		run[job->job.bank].flips += result.flips;
+		run[job->job.bank].ecc += yield;
+
+		if(++done % BUDGET_SAVE_EVERY == 0) {
+			budget_save_history(budget, &ctx->dram);
+		}
+	}
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+	if(budget_stop) {
+		pr_info("[BUDGET] Interrupted, stopping\n");
+	}
+
+	budget_summary(ctx, budget, run, timing_now_ns() - t_start);
+	if((rv = budget_save_history(budget, &ctx->dram)) == 0 && budget->history_path) {
+		pr_info("[BUDGET] History saved to %s\n", budget->history_path);
+	}
+
+out:
+	hammer_ctx_unmap_buffers(ctx);
+	free(jobs);
+	return rv;
+}
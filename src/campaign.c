@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include "campaign.h"
+
+/* Campaign file, one axis per line, values separated by blanks:
+ *
+ *   # comment
+ *   activations 0.5 1 2         (millions, like -n)
+ *   rounds 1 5 17
+ *   pattern ff:00 00:ff         (aggressor:victim byte)
+ *   banks all                   (or a list, ranges a-b allowed)
+ *   buffers 4
+ *   output campaign.csv
+ *
+ * Missing axes take the command line configuration. The sweep is the
+ * cartesian product of all axes. */
+
+static int campaign_parse_banks(campaign_t *campaign, const char *tok, const dram_profile_t *dram)
+{
+	unsigned lo, hi;
+
+	if(strcmp(tok, "all") == 0) {
+		for(lo = 0; lo < dram->nbanks && campaign->nbanks < MAX_CONTROLLED_BANKS; ++lo) {
+			campaign->banks[campaign->nbanks++] = lo;
+		}
+		return 0;
+	}
+
+	if(sscanf(tok, "%u-%u", &lo, &hi) != 2) {
+		if(sscanf(tok, "%u", &lo) != 1) {
+			return -1;
+		}
+		hi = lo;
+	}
+	for(; lo <= hi; ++lo) {
+		if(lo >= (1U << dram->nmasks) || campaign->nbanks == MAX_CONTROLLED_BANKS) {
+			return -1;
+		}
+		campaign->banks[campaign->nbanks++] = lo;
+	}
+	return 0;
+}
+
+/* Parse a campaign file. Returns 0, or -1 with a message on stderr. */
+int campaign_load(campaign_t *campaign, const char *path, const dram_profile_t *dram)
+{
+	char line[CAMPAIGN_LINE_MAX], *key, *tok, *save;
+	unsigned lineno, agg, vic;
+	FILE *fp;
+	int rv;
+
+	memset(campaign, 0, sizeof(campaign_t));
+	strcpy(campaign->output, CAMPAIGN_DEFAULT_OUTPUT);
+
+	fp = fopen(path, "r");
+	if(fp == NULL) {
+		pr_err("[ERROR] Cannot open campaign %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+
+	rv = 0;
+	lineno = 0;
+	while(rv == 0 && fgets(line, sizeof(line), fp)) {
+		++lineno;
+		line[strcspn(line, "#\r\n")] = '\0';
+		if((key = strtok_r(line, " \t", &save)) == NULL) {
+			continue;
+		}
+
+		while(rv == 0 && (tok = strtok_r(NULL, " \t", &save)) != NULL) {
+			if(strcmp(key, "activations") == 0 && campaign->nactivations < CAMPAIGN_MAX_VALUES) {
+				campaign->activations[campaign->nactivations++] = atof(tok) * 1000000;
+			}
+			else if(strcmp(key, "rounds") == 0 && campaign->nrounds < CAMPAIGN_MAX_VALUES) {
+				campaign->rounds[campaign->nrounds++] = strtoull(tok, NULL, 10);
+			}
+			else if(strcmp(key, "pattern") == 0 && campaign->npatterns < CAMPAIGN_MAX_VALUES &&
+					sscanf(tok, "%x:%x", &agg, &vic) == 2 && agg <= 0xFF && vic <= 0xFF) {
+				campaign->agg_patterns[campaign->npatterns] = agg;
+				campaign->victim_patterns[campaign->npatterns++] = vic;
+			}
+			else if(strcmp(key, "banks") == 0 && campaign_parse_banks(campaign, tok, dram) == 0) {
+				continue;
+			}
+			else if(strcmp(key, "buffers") == 0) {
+				campaign->nbuffers = strtoul(tok, NULL, 10);
+			}
+			else if(strcmp(key, "output") == 0 && strlen(tok) < sizeof(campaign->output)) {
+				strcpy(campaign->output, tok);
+			}
+			else {
+				pr_err("[ERROR] %s:%u: bad value '%s' for %s\n", path, lineno, tok, key);
+				rv = -1;
+			}
+		}
+	}
+	fclose(fp);
+
+	if(campaign->nbuffers > HAMMER_MAX_BUFFERS) {
+		pr_err("[ERROR] %s: at most %u buffers\n", path, HAMMER_MAX_BUFFERS);
+		rv = -1;
+	}
+	return rv;
+}
+
+/* Fill the axes the file left out from the command line config. */
+static void campaign_defaults(hammer_ctx_t *ctx, campaign_t *campaign)
+{
+	if(campaign->nactivations == 0) {
+		campaign->activations[campaign->nactivations++] = ctx->conf.num_row_activations;
+	}
+	if(campaign->nrounds == 0) {
+		campaign->rounds[campaign->nrounds++] = ctx->conf.hammering_rounds;
+	}
+	if(campaign->npatterns == 0) {
+		campaign->agg_patterns[campaign->npatterns] = 0xFF;
+		campaign->victim_patterns[campaign->npatterns++] = 0x00;
+	}
+	if(campaign->nbanks == 0) {
+		campaign_parse_banks(campaign, "all", &ctx->dram);
+	}
+	if(campaign->nbuffers == 0) {
+		campaign->nbuffers = 1;
+	}
+}
+
+static void campaign_on_result(hammer_ctx_t *ctx, const hammer_result_t *result, void *arg)
+{
+	campaign_cell_t *cell;
+
+	cell = (campaign_cell_t *) arg;
+	if(result->status) {
+		return;
+	}
+	cell->jobs++;
+	cell->flips += result->flips;
+	cell->flips_0_to_1 += result->flips_0_to_1;
+	cell->flips_1_to_0 += result->flips_1_to_0;
+	cell->total_acts += result->activations;
+	cell->elapsed_ns += result->elapsed_ns;
+	cell->load_bytes += result->load_mbps * result->elapsed_ns / 1e3;
+	if(result->have_edac) {
+		cell->edac_ce += result->edac.ce;
+		cell->edac_ue += result->edac.ue;
+	}
+}
+
+/* Flips per setting (pattern, activations, rounds) summed over
+   banks and buffers, and the setting with the most flips. */
+static void campaign_summary(campaign_t *campaign, campaign_cell_t *cells, unsigned ncells)
+{
+	uint64_t flips, elapsed, best_flips;
+	unsigned p, a, r, i, best;
+	campaign_cell_t *cell;
+
+	best = ncells;
+	best_flips = 0;
+	for(p = 0; p < campaign->npatterns; ++p) {
+		for(a = 0; a < campaign->nactivations; ++a) {
+			for(r = 0; r < campaign->nrounds; ++r) {
+				flips = 0;
+				elapsed = 0;
+				for(i = 0; i < ncells; ++i) {
+					cell = &cells[i];
+					if(cell->agg_pattern == campaign->agg_patterns[p] &&
+					   cell->victim_pattern == campaign->victim_patterns[p] &&
+					   cell->activations == campaign->activations[a] && cell->rounds == campaign->rounds[r]) {
+						flips += cell->flips;
+						elapsed += cell->elapsed_ns;
+					}
+				}
+				pr_info("[INFO] pattern %02x:%02x %0.2fM x %lu: %lu flips, %0.2f flips/s\n",
+						campaign->agg_patterns[p], campaign->victim_patterns[p],
+						(double) campaign->activations[a] / 1e6, campaign->rounds[r], flips,
+						elapsed ? flips * 1e9 / elapsed : 0);
+				if(flips > best_flips) {
+					best_flips = flips;
+					best = (p * campaign->nactivations + a) * campaign->nrounds + r;
+				}
+			}
+		}
+	}
+
+	if(best == ncells) {
+		pr_info("[INFO] No flips in this campaign\n");
+		return;
+	}
+	r = best % campaign->nrounds;
+	a = (best / campaign->nrounds) % campaign->nactivations;
+	p = best / campaign->nrounds / campaign->nactivations;
+	pr_info("[INFO] Best setting: -n %0.2f -R %lu, pattern %02x:%02x (%lu flips)\n",
+			(double) campaign->activations[a] / 1e6, campaign->rounds[r],
+			campaign->agg_patterns[p], campaign->victim_patterns[p], best_flips);
+}
+
+/* Run the sweep in one process. All buffers are mapped once and the
+   loops nest so that the outer ones change the least state: buffer,
+   then bank (same rows, same addresses), then the data pattern, and
+   the hammering parameters innermost, which only need the triplet
+   patterns rewritten. Writes one CSV row per cell. */
+int campaign_run(hammer_ctx_t *ctx, campaign_t *campaign, unsigned first_slot)
+{
+	hammer_job_t jobs[MAX_CONTROLLED_ROWS];
+	hammer_result_t *results;
+	campaign_cell_t *cells, *cell;
+	unsigned buf, b, p, a, r, ncells, i;
+	size_t njobs, k;
+	FILE *fp;
+	int rv;
+
+	campaign_defaults(ctx, campaign);
+	ncells = campaign->nbuffers * campaign->nbanks * campaign->npatterns * campaign->nactivations * campaign->nrounds;
+	pr_info("[INFO] Campaign: %u buffers x %u banks x %u patterns x %u activations x %u rounds = %u cells\n",
+			campaign->nbuffers, campaign->nbanks, campaign->npatterns, campaign->nactivations,
+			campaign->nrounds, ncells);
+
+	cells = calloc(ncells, sizeof(campaign_cell_t));
+	results = malloc(sizeof(hammer_result_t) * MAX_CONTROLLED_ROWS);
+	if(cells == NULL || results == NULL) {
+		rv = -ENOMEM;
+		goto out;
+	}
+
+	if((rv = hammer_ctx_map_buffers(ctx, first_slot, campaign->nbuffers))) {
+		goto out;
+	}
+
+	i = 0;
+	for(buf = 0; buf < campaign->nbuffers; ++buf) {
+		for(b = 0; b < campaign->nbanks; ++b) {
+			njobs = hammer_bank_jobs(ctx, buf, campaign->banks[b], jobs, MAX_CONTROLLED_ROWS);
+			for(p = 0; p < campaign->npatterns; ++p) {
+				for(a = 0; a < campaign->nactivations; ++a) {
+					for(r = 0; r < campaign->nrounds; ++r) {
+						cell = &cells[i++];
+						cell->buffer = buf;
+						cell->bank = campaign->banks[b];
+						cell->agg_pattern = campaign->agg_patterns[p];
+						cell->victim_pattern = campaign->victim_patterns[p];
+						cell->activations = campaign->activations[a];
+						cell->rounds = campaign->rounds[r];
+
+						for(k = 0; k < njobs; ++k) {
+							jobs[k].agg_pattern = cell->agg_pattern;
+							jobs[k].victim_pattern = cell->victim_pattern;
+							jobs[k].activations = cell->activations;
+							jobs[k].rounds = cell->rounds;
+						}
+						hammer_ctx_set_callback(ctx, campaign_on_result, cell);
+						hammer_run_jobs(ctx, jobs, njobs, results);
+
+						pr_info("[CELL] buffer %u bank %u pattern %02x:%02x %0.2fM x %lu: %lu flips in %0.2f s\n",
+								cell->buffer, cell->bank, cell->agg_pattern, cell->victim_pattern,
+								(double) cell->activations / 1e6, cell->rounds, cell->flips,
+								(double) cell->elapsed_ns / 1e9);
+					}
+				}
+			}
+		}
+	}
+	hammer_ctx_set_callback(ctx, NULL, NULL);
+	hammer_ctx_unmap_buffers(ctx);
+
+	fp = fopen(campaign->output, "w");
+	if(fp == NULL) {
+		rv = -errno;
+		goto out;
+	}
+	fprintf(fp, "buffer,bank,agg_pattern,victim_pattern,activations,rounds,jobs,flips,flips_0_to_1,flips_1_to_0,total_acts,elapsed_ns,edac_ce,edac_ue,load_mbps\n");
+	for(i = 0; i < ncells; ++i) {
+		cell = &cells[i];
+		fprintf(fp, "%u,%u,0x%02x,0x%02x,%lu,%lu,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%0.0f\n", cell->buffer, cell->bank,
+				cell->agg_pattern, cell->victim_pattern, cell->activations, cell->rounds, cell->jobs,
+				cell->flips, cell->flips_0_to_1, cell->flips_1_to_0, cell->total_acts, cell->elapsed_ns,
+				cell->edac_ce, cell->edac_ue, cell->elapsed_ns ? cell->load_bytes * 1e3 / cell->elapsed_ns : 0);
+	}
+	fclose(fp);
+	pr_info("[INFO] Campaign matrix (%u cells) written to %s\n", ncells, campaign->output);
+	campaign_summary(campaign, cells, ncells);
+
+out:
+	free(cells);
+	free(results);
+	return rv;
+}
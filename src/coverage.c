@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include "coverage.h"
+
+/* Coverage file, the configuration the triplets were hammered with
+ * and one line per buffer slot, bank and pattern pair:
+ *
+ *   config <profile> <banks> <rows> <activations> <rounds> <blast radius>
+ *   <slot> <bank> <agg pattern> <victim pattern> <victim rows, hex bitmap>
+ *
+ * Slots are the 2MB virtual slots the buffers were mapped at, which
+ * are backed by other physical pages every run: the file records what
+ * a sweep got through, not which cells were tested. */
+
+static uint64_t *__coverage_rows(coverage_t *cov, unsigned slot, unsigned bank, uint8_t agg, uint8_t victim, int add)
+{
+	unsigned p;
+
+	if(slot >= COVERAGE_MAX_SLOTS || bank >= MAX_CONTROLLED_BANKS) {
+		return NULL;
+	}
+	for(p = 0; p < cov->npatterns; ++p) {
+		if(cov->patterns[p][0] == agg && cov->patterns[p][1] == victim) {
+			return &cov->rows[slot][p][bank];
+		}
+	}
+	if(!add || cov->npatterns == COVERAGE_MAX_PATTERNS) {
+		return NULL;
+	}
+	cov->patterns[cov->npatterns][0] = agg;
+	cov->patterns[cov->npatterns][1] = victim;
+	return &cov->rows[slot][cov->npatterns++][bank];
+}
+
+static __always_inline unsigned __coverage_slot(const hammer_ctx_t *ctx, unsigned buffer)
+{
+	return (uintptr_t) ctx->buffers[buffer] / BUFFER_SIZE;
+}
+
+/* Empty coverage of the configuration of ctx, saved to path. */
+void coverage_init(coverage_t *cov, const char *path, const hammer_ctx_t *ctx)
+{
+	memset(cov, 0, sizeof(coverage_t));
+	pthread_mutex_init(&cov->lock, NULL);
+	cov->path = path;
+	strncpy(cov->profile, ctx->dram.name, ROWMAP_PROFILE_LEN - 1);
+	cov->nbanks = ctx->dram.nbanks;
+	cov->nrows = ctx->dram.nrows;
+	cov->activations = ctx->conf.num_row_activations;
+	cov->rounds = ctx->conf.hammering_rounds;
+	cov->blast_radius = ctx->conf.blast_radius;
+}
+
+/* Returns 0, -ENOENT without a file, -ESTALE if it was written under
+   another configuration and -EINVAL if it is malformed. */
+int coverage_load(coverage_t *cov)
+{
+	char name[ROWMAP_PROFILE_LEN];
+	unsigned nbanks, nrows, radius, slot, bank, agg, victim;
+	uint64_t activations, rounds, rows, *covered;
+	FILE *fp;
+	int rv;
+
+	fp = fopen(cov->path, "r");
+	if(fp == NULL) {
+		return -ENOENT;
+	}
+
+	if(fscanf(fp, "config %31s %u %u %" SCNu64 " %" SCNu64 " %u", name, &nbanks, &nrows,
+			  &activations, &rounds, &radius) != 6) {
+		rv = -EINVAL;
+		goto out;
+	}
+	if(strcmp(name, cov->profile) || nbanks != cov->nbanks || nrows != cov->nrows ||
+	   activations != cov->activations || rounds != cov->rounds || radius != cov->blast_radius) {
+		rv = -ESTALE;
+		goto out;
+	}
+	while((rv = fscanf(fp, "%u %u %x %x %" SCNx64, &slot, &bank, &agg, &victim, &rows)) == 5) {
+		if((covered = __coverage_rows(cov, slot, bank, agg, victim, 1)) == NULL) {
+			rv = -EINVAL;
+			goto out;
+		}
+		cov->nloaded += __builtin_popcountll(rows & ~*covered);
+		*covered |= rows;
+	}
+	rv = rv == EOF ? 0 : -EINVAL;
+	cov->ncovered = cov->nloaded;
+
+out:
+	fclose(fp);
+	return rv;
+}
+
+static void __coverage_write(FILE *fp, void *arg)
+{
+	coverage_t *cov = arg;
+	unsigned s, p, b;
+
+	fprintf(fp, "config %s %u %u %lu %lu %u\n", cov->profile, cov->nbanks, cov->nrows,
+			cov->activations, cov->rounds, cov->blast_radius);
+	for(s = 0; s < COVERAGE_MAX_SLOTS; ++s) {
+		for(p = 0; p < cov->npatterns; ++p) {
+			for(b = 0; b < MAX_CONTROLLED_BANKS; ++b) {
+				if(cov->rows[s][p][b]) {
+					fprintf(fp, "%u %u %02x %02x %lx\n", s, b, cov->patterns[p][0], cov->patterns[p][1],
+							cov->rows[s][p][b]);
+				}
+			}
+		}
+	}
+}
+
+static int __coverage_save(coverage_t *cov)
+{
+	int rv;
+
+	if((rv = save_atomic(cov->path, __coverage_write, cov)) == 0) {
+		cov->last_flush_ns = timing_now_ns();
+	}
+	return rv;
+}
+
+/* Write to <path>.tmp and rename, a save cut short by a crash
+   leaves the previous coverage in place. */
+int coverage_save(coverage_t *cov)
+{
+	int rv;
+
+	pthread_mutex_lock(&cov->lock);
+	rv = __coverage_save(cov);
+	pthread_mutex_unlock(&cov->lock);
+	return rv;
+}
+
+/* Was the victim of job already hammered and scanned? */
+int coverage_done(coverage_t *cov, const hammer_ctx_t *ctx, const hammer_job_t *job)
+{
+	uint64_t *covered;
+	int rv;
+
+	if(job->buffer >= ctx->nbuffers || job->victim_row >= MAX_CONTROLLED_ROWS) {
+		return 0;
+	}
+	pthread_mutex_lock(&cov->lock);
+	covered = __coverage_rows(cov, __coverage_slot(ctx, job->buffer), job->bank, job->agg_pattern,
+							  job->victim_pattern, 0);
+	rv = covered && ((*covered >> job->victim_row) & 1);
+	pthread_mutex_unlock(&cov->lock);
+	return rv;
+}
+
+/* Record a completed triplet, rewriting the file if the last
+   save is older than COVERAGE_FLUSH_NS. */
+void coverage_mark(coverage_t *cov, const hammer_ctx_t *ctx, const hammer_result_t *result)
+{
+	uint64_t *covered;
+
+	if(result->status || result->rows[1] >= MAX_CONTROLLED_ROWS) {
+		return;
+	}
+	pthread_mutex_lock(&cov->lock);
+	covered = __coverage_rows(cov, __coverage_slot(ctx, result->buffer), result->bank, result->agg_pattern,
+							  result->victim_pattern, 1);
+	if(covered == NULL) {
+		cov->nlost++;
+	}
+	else if(!((*covered >> result->rows[1]) & 1)) {
+		*covered |= 1ULL << result->rows[1];
+		cov->ncovered++;
+	}
+	if(timing_now_ns() - cov->last_flush_ns >= COVERAGE_FLUSH_NS) {
+		__coverage_save(cov);
+	}
+	pthread_mutex_unlock(&cov->lock);
+}
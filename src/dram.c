@@ -0,0 +1,112 @@
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "util.h"
+#include "hammer.h"
+
+/* HARDCODED DRAM CONFIG */
+static const dram_profile_t dram_profiles[] = {
+	{
+		.name = "hwsec05",
+		.gen = DRAM_DDR3,
+		.nmasks = 4,
+		.function_masks = {
+			0x22000,	// BA0(13, 17)
+			0x44000, 	// BA1(14, 18)
+			0x110000, 	// BA2(16, 20)
+			0x88000, 	// RANK(15, 19)
+		},
+		.row_mask = 0x1e0000,
+		.hammer = hammer_ddr3_backend,
+		.hammer_interleaved = hammer_interleaved,
+	},
+	{
+		/* Intel client, 1 DIMM / 2 ranks. Only the functions
+		   below bit 21 are controllable inside a huge page.
+		   BG0(6, 13) alternates bank groups every 64 bytes of a
+		   ROW_SIZE chunk and is left out: rows are hammered at
+		   bit 6 and 13 clear, scanned and restored as a chunk. */
+		.name = "ddr4",
+		.gen = DRAM_DDR4,
+		.nmasks = 4,
+		.function_masks = {
+			0x24000,	// BG1(14, 17)
+			0x48000,	// BA0(15, 18)
+			0x90000,	// BA1(16, 19)
+			0x120000,	// RANK(17, 20)
+		},
+		.row_mask = 0x1c0000,
+		.hammer = hammer_ddr4_backend,
+		.hammer_interleaved = hammer_interleaved_ddr4,
+	},
+};
+
+#define NUM_DRAM_PROFILES (sizeof(dram_profiles) / sizeof(dram_profiles[0]))
+
+/* Derive nrows and nbanks. Returns -1 if the geometry is past
+   what a context can hold or a function uses a bit below ROW_SIZE,
+   which would split every row chunk between two banks. */
+int dram_check_profile(dram_profile_t *profile)
+{
+	unsigned i;
+
+	profile->nrows = 1 << __builtin_popcountl(profile->row_mask);
+	profile->nbanks = 1 << profile->nmasks;
+	if(profile->nmasks > MAX_FUNC_MASKS || profile->nrows > MAX_CONTROLLED_ROWS ||
+	   profile->nbanks > MAX_CONTROLLED_BANKS) {
+		return -1;
+	}
+	for(i = 0; i < profile->nmasks; ++i) {
+		if(profile->function_masks[i] & (ROW_SIZE - 1)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Copy the profile matching a generation ("ddr3"/"ddr4")
+   or a name into profile. Returns -1 if there is none. */
+int dram_select_profile(const char *which, dram_profile_t *profile)
+{
+	unsigned i;
+
+	for(i = 0; i < NUM_DRAM_PROFILES; ++i) {
+		if(strcmp(dram_profiles[i].name, which) == 0 ||
+		   (strncmp(which, "ddr", 3) == 0 && atoi(which + 3) == dram_profiles[i].gen)) {
+			*profile = dram_profiles[i];
+			return dram_check_profile(profile);
+		}
+	}
+
+	return -1;
+}
+
+uintptr_t dram_to_physical(const dram_profile_t *dram, dram_addr_t dram_addr)
+{
+	unsigned i, bit_pos;
+	uint64_t row_offset;
+	uintptr_t physaddr;
+
+	row_offset = __builtin_ctzl(dram->row_mask);
+	physaddr = dram_addr.row << row_offset;
+	for(i = 0; i < dram->nmasks; ++i) {
+
+		// make sure that when you set the function bits you're not setting bits which conflict with the row bits.
+
+		if(__builtin_parityl((uintptr_t) physaddr & dram->function_masks[i]) == dram_addr.ch_to_bank[i]) {
+			continue;
+		}
+
+		if(__builtin_clzl(dram->function_masks[i] & 1L)) { // if hsb of the fn is set, unset the lower one.
+			bit_pos = 1 << __builtin_ctzl(dram->function_masks[i]);
+		}
+		else if(__builtin_ctzl(dram->function_masks[i] & 1L)) { // if lsb of the fn is set, unset the upper one.
+			bit_pos = 1 << __builtin_clzl(dram->function_masks[i]);
+		}
+		
+		physaddr ^= bit_pos; // unset the "conflicting bit"
+		physaddr |= dram_addr.ch_to_bank[i] << __builtin_ctzl(dram->function_masks[i]); // set the "correct bit"
+
+	}
+	return physaddr;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include "edac.h"
+
+static int __mc_compare(const void *t1, const void *t2)
+{
+	return *(int *) t1 - *(int *) t2;
+}
+
+static int __edac_read_count(const char *root, int mc, const char *name, uint64_t *count)
+{
+	char path[EDAC_PATH_LEN + 64];
+	FILE *fp;
+	int rv;
+
+	snprintf(path, sizeof(path), "%s/mc/mc%d/%s", root, mc, name);
+	fp = fopen(path, "r");
+	if(fp == NULL) {
+		return -errno;
+	}
+	rv = fscanf(fp, "%" SCNu64, count) == 1 ? 0 : -EINVAL;
+	fclose(fp);
+	return rv;
+}
+
+/* Find the controllers under root. Returns -ENODEV if there
+   is none with readable ce_count/ue_count. */
+int edac_open(edac_t *edac, const char *root)
+{
+	char path[EDAC_PATH_LEN + 8];
+	struct dirent *entry;
+	uint64_t count;
+	DIR *dir;
+	int mc;
+
+	memset(edac, 0, sizeof(edac_t));
+	snprintf(edac->root, sizeof(edac->root), "%s", root ? root : EDAC_DEFAULT_ROOT);
+
+	snprintf(path, sizeof(path), "%s/mc", edac->root);
+	dir = opendir(path);
+	if(dir == NULL) {
+		return -ENODEV;
+	}
+	while((entry = readdir(dir)) != NULL && edac->nmcs < EDAC_MAX_MCS) {
+		if(sscanf(entry->d_name, "mc%d", &mc) != 1) {
+			continue;
+		}
+		if(__edac_read_count(edac->root, mc, "ce_count", &count) ||
+		   __edac_read_count(edac->root, mc, "ue_count", &count)) {
+			continue;
+		}
+		edac->mc_ids[edac->nmcs++] = mc;
+	}
+	closedir(dir);
+
+	qsort(edac->mc_ids, edac->nmcs, sizeof(int), __mc_compare);
+	return edac->nmcs ? 0 : -ENODEV;
+}
+
+int edac_snapshot(edac_t *edac, edac_counts_t *counts)
+{
+	unsigned i;
+	int rv;
+
+	for(i = 0; i < edac->nmcs; ++i) {
+		if((rv = __edac_read_count(edac->root, edac->mc_ids[i], "ce_count", &counts->ce[i])) ||
+		   (rv = __edac_read_count(edac->root, edac->mc_ids[i], "ue_count", &counts->ue[i]))) {
+			return rv;
+		}
+	}
+	return 0;
+}
+
+/* Counters only go up unless someone writes reset_counters,
+   a controller that went backwards is skipped. */
+void edac_delta(edac_t *edac, const edac_counts_t *before, const edac_counts_t *after, edac_delta_t *delta)
+{
+	unsigned i;
+
+	memset(delta, 0, sizeof(edac_delta_t));
+	delta->mc = -1;
+	for(i = 0; i < edac->nmcs; ++i) {
+		if(after->ce[i] < before->ce[i] || after->ue[i] < before->ue[i]) {
+			continue;
+		}
+		delta->ce += after->ce[i] - before->ce[i];
+		delta->ue += after->ue[i] - before->ue[i];
+		if(delta->mc < 0 && (after->ce[i] != before->ce[i] || after->ue[i] != before->ue[i])) {
+			delta->mc = edac->mc_ids[i];
+		}
+	}
+}
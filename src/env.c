@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "env.h"
+#include "numa.h"
+
+static int __env_read_line(const char *path, char *line, size_t sz)
+{
+	FILE *fp;
+	int rv;
+
+	fp = fopen(path, "r");
+	if(fp == NULL) {
+		return -1;
+	}
+	rv = fgets(line, sz, fp) == NULL ? -1 : 0;
+	fclose(fp);
+	if(rv == 0) {
+		line[strcspn(line, "\n")] = '\0';
+	}
+	return rv;
+}
+
+static void __env_isolated(cpu_set_t *set)
+{
+	char line[4096];
+
+	CPU_ZERO(set);
+	if(!__env_read_line(ENV_SYSFS_CPUS "/isolated", line, sizeof(line))) {
+		numa_parse_cpulist(line, set);
+	}
+}
+
+/* An isolated CPU out of allowed if there is one, else the
+   highest allowed CPU, which housekeeping is least likely on. */
+int env_pick_cpu(const cpu_set_t *allowed)
+{
+	cpu_set_t isolated;
+	int cpu, last;
+
+	__env_isolated(&isolated);
+	last = ENV_NO_CPU;
+	for(cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		if(!CPU_ISSET(cpu, allowed)) {
+			continue;
+		}
+		if(CPU_ISSET(cpu, &isolated)) {
+			return cpu;
+		}
+		last = cpu;
+	}
+	return last;
+}
+
+/* Pin the calling thread to a single CPU. */
+int env_pin_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+}
+
+/* Run the calling thread as SCHED_FIFO, needs CAP_SYS_NICE. */
+int env_set_fifo(int prio)
+{
+	struct sched_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = prio;
+	return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+/* Record isolation, scheduling, frequency and SMT state of cpu. */
+void env_probe(exec_env_t *env, int cpu)
+{
+	struct sched_param param;
+	cpu_set_t isolated, siblings;
+	char path[128], line[4096];
+	int policy, i;
+
+	memset(env, 0, sizeof(exec_env_t));
+	env->cpu = cpu;
+	env->smt_active = -1;
+	env->sibling = -1;
+
+	__env_isolated(&isolated);
+	env->nisolated = CPU_COUNT(&isolated);
+
+	if(pthread_getschedparam(pthread_self(), &policy, &param) == 0 && policy == SCHED_FIFO) {
+		env->fifo_prio = param.sched_priority;
+	}
+
+	if(!__env_read_line(ENV_SYSFS_CPUS "/smt/active", line, sizeof(line))) {
+		env->smt_active = atoi(line);
+	}
+
+	if(cpu < 0) {
+		cpu = sched_getcpu();
+		if(cpu < 0) {
+			return;
+		}
+	}
+	env->isolated = CPU_ISSET(cpu, &isolated) ? 1 : 0;
+
+	snprintf(path, sizeof(path), ENV_SYSFS_CPUS "/cpu%d/cpufreq/scaling_governor", cpu);
+	if(!__env_read_line(path, line, sizeof(line))) {
+		line[ENV_GOVERNOR_LEN - 1] = '\0';
+		memcpy(env->governor, line, strlen(line) + 1);
+	}
+	snprintf(path, sizeof(path), ENV_SYSFS_CPUS "/cpu%d/cpufreq/scaling_cur_freq", cpu);
+	if(!__env_read_line(path, line, sizeof(line))) {
+		env->cur_khz = strtoul(line, NULL, 10);
+	}
+	snprintf(path, sizeof(path), ENV_SYSFS_CPUS "/cpu%d/cpufreq/scaling_min_freq", cpu);
+	if(!__env_read_line(path, line, sizeof(line))) {
+		env->min_khz = strtoul(line, NULL, 10);
+	}
+	snprintf(path, sizeof(path), ENV_SYSFS_CPUS "/cpu%d/cpufreq/scaling_max_freq", cpu);
+	if(!__env_read_line(path, line, sizeof(line))) {
+		env->max_khz = strtoul(line, NULL, 10);
+	}
+
+	/* An online sibling shares the core's caches and ports */
+	snprintf(path, sizeof(path), ENV_SYSFS_CPUS "/cpu%d/topology/thread_siblings_list", cpu);
+	if(!__env_read_line(path, line, sizeof(line)) && !numa_parse_cpulist(line, &siblings)) {
+		for(i = 0; i < CPU_SETSIZE; ++i) {
+			if(i != cpu && CPU_ISSET(i, &siblings)) {
+				env->sibling = i;
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,366 @@
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include "util.h"
+#include "flipmap.h"
+
+#define FLIPMAP_LOW_MASK ((1U << FLIPMAP_CONTAINER_BITS) - 1)
+
+static __always_inline flipmap_set_t *__flipmap_dir(flipmap_t *fm, int direction)
+{
+	return &fm->dir[direction == ZERO_TO_ONE ? 0 : 1];
+}
+
+/* Position of key in set, or where it has to be inserted. */
+static uint32_t __set_find(flipmap_set_t *set, uint64_t key, int *found)
+{
+	uint32_t lo, hi, mid;
+
+	lo = 0;
+	hi = set->n;
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(set->containers[mid].key < key) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	*found = lo < set->n && set->containers[lo].key == key;
+	return lo;
+}
+
+static flipmap_container_t *__set_container(flipmap_set_t *set, uint64_t key)
+{
+	flipmap_container_t *containers;
+	uint32_t pos;
+	int found;
+
+	pos = __set_find(set, key, &found);
+	if(found) {
+		return &set->containers[pos];
+	}
+
+	if(set->n == set->cap) {
+		containers = realloc(set->containers, (set->cap ? 2 * set->cap : 16) * sizeof(flipmap_container_t));
+		if(containers == NULL) {
+			return NULL;
+		}
+		set->containers = containers;
+		set->cap = set->cap ? 2 * set->cap : 16;
+	}
+	memmove(&set->containers[pos + 1], &set->containers[pos], (set->n - pos) * sizeof(flipmap_container_t));
+	memset(&set->containers[pos], 0, sizeof(flipmap_container_t));
+	set->containers[pos].key = key;
+	set->n++;
+	return &set->containers[pos];
+}
+
+/* Array position of low, or where it has to be inserted. */
+static uint32_t __array_find(const uint16_t *array, uint32_t card, uint16_t low, int *found)
+{
+	uint32_t lo, hi, mid;
+
+	lo = 0;
+	hi = card;
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(array[mid] < low) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	*found = lo < card && array[lo] == low;
+	return lo;
+}
+
+static int __container_to_bitmap(flipmap_container_t *c)
+{
+	uint64_t *bitmap;
+	uint16_t *array;
+	uint32_t i;
+
+	bitmap = calloc(FLIPMAP_BITMAP_WORDS, sizeof(uint64_t));
+	if(bitmap == NULL) {
+		return -ENOMEM;
+	}
+	array = (uint16_t *) c->data;
+	for(i = 0; i < c->card; ++i) {
+		bitmap[array[i] / 64] |= 1ULL << (array[i] % 64);
+	}
+	free(c->data);
+	c->data = bitmap;
+	c->cap = 0;
+	return 0;
+}
+
+static int __container_has(const flipmap_container_t *c, uint16_t low)
+{
+	int found;
+
+	if(c->cap == 0 && c->data) {
+		return (((uint64_t *) c->data)[low / 64] >> (low % 64)) & 1;
+	}
+	__array_find((uint16_t *) c->data, c->card, low, &found);
+	return found;
+}
+
+/* Returns 1 if low was new, 0 if it was there, -ENOMEM. */
+static int __container_add(flipmap_container_t *c, uint16_t low)
+{
+	uint64_t *bitmap;
+	uint16_t *array;
+	uint32_t pos, cap;
+	int found;
+
+	if(c->cap == 0 && c->data) {
+		bitmap = (uint64_t *) c->data;
+		if((bitmap[low / 64] >> (low % 64)) & 1) {
+			return 0;
+		}
+		bitmap[low / 64] |= 1ULL << (low % 64);
+		c->card++;
+		return 1;
+	}
+
+	pos = __array_find((uint16_t *) c->data, c->card, low, &found);
+	if(found) {
+		return 0;
+	}
+
+	if(c->card == FLIPMAP_ARRAY_MAX) {
+		if(__container_to_bitmap(c)) {
+			return -ENOMEM;
+		}
+		return __container_add(c, low);
+	}
+
+	if(c->card == c->cap) {
+		cap = c->cap ? 2 * c->cap : 4;
+		array = realloc(c->data, cap * sizeof(uint16_t));
+		if(array == NULL) {
+			return -ENOMEM;
+		}
+		c->data = array;
+		c->cap = cap;
+	}
+
+	array = (uint16_t *) c->data;
+	memmove(&array[pos + 1], &array[pos], (c->card - pos) * sizeof(uint16_t));
+	array[pos] = low;
+	c->card++;
+	return 1;
+}
+
+static int __container_merge(flipmap_container_t *dst, const flipmap_container_t *src)
+{
+	uint64_t *bitmap;
+	uint16_t *array;
+	uint32_t i, card;
+	int rv;
+
+	if(src->cap == 0 && src->data) {
+		/* Bitmap source: the union is a bitmap too */
+		if(!(dst->cap == 0 && dst->data)) {
+			if(dst->data == NULL && (dst->data = malloc(sizeof(uint16_t))) == NULL) {
+				return -ENOMEM;
+			}
+			if(__container_to_bitmap(dst)) {
+				return -ENOMEM;
+			}
+		}
+		bitmap = (uint64_t *) dst->data;
+		card = 0;
+		for(i = 0; i < FLIPMAP_BITMAP_WORDS; ++i) {
+			bitmap[i] |= ((uint64_t *) src->data)[i];
+			card += __builtin_popcountll(bitmap[i]);
+		}
+		dst->card = card;
+		return 0;
+	}
+
+	array = (uint16_t *) src->data;
+	for(i = 0; i < src->card; ++i) {
+		if((rv = __container_add(dst, array[i])) < 0) {
+			return rv;
+		}
+	}
+	return 0;
+}
+
+static void __set_free(flipmap_set_t *set)
+{
+	uint32_t i;
+
+	for(i = 0; i < set->n; ++i) {
+		free(set->containers[i].data);
+	}
+	free(set->containers);
+	memset(set, 0, sizeof(flipmap_set_t));
+}
+
+void flipmap_init(flipmap_t *fm)
+{
+	memset(fm, 0, sizeof(flipmap_t));
+}
+
+void flipmap_free(flipmap_t *fm)
+{
+	__set_free(&fm->dir[0]);
+	__set_free(&fm->dir[1]);
+}
+
+/* Record a flip of bit of the byte at addr. Returns 1 if it
+   is new, 0 if the bit already flipped, -ENOMEM. */
+int flipmap_add(flipmap_t *fm, uintptr_t addr, unsigned bit, int direction)
+{
+	flipmap_container_t *c;
+	uint64_t index;
+
+	index = (uint64_t) addr * 8 + bit;
+	c = __set_container(__flipmap_dir(fm, direction), index >> FLIPMAP_CONTAINER_BITS);
+	if(c == NULL) {
+		return -ENOMEM;
+	}
+	return __container_add(c, index & FLIPMAP_LOW_MASK);
+}
+
+/* Record every bit where observed differs from expected.
+   Returns the number of new flips or -ENOMEM. */
+int flipmap_add_byte(flipmap_t *fm, uintptr_t addr, uint8_t expected, uint8_t observed)
+{
+	uint8_t diff;
+	unsigned bit;
+	int rv, n;
+
+	n = 0;
+	diff = expected ^ observed;
+	while(diff) {
+		bit = __builtin_ctz(diff);
+		diff &= diff - 1;
+		rv = flipmap_add(fm, addr, bit, (observed >> bit) & 1 ? ZERO_TO_ONE : ONE_TO_ZERO);
+		if(rv < 0) {
+			return rv;
+		}
+		n += rv;
+	}
+	return n;
+}
+
+int flipmap_contains(flipmap_t *fm, uintptr_t addr, unsigned bit, int direction)
+{
+	flipmap_set_t *set;
+	uint64_t index;
+	uint32_t pos;
+	int found;
+
+	index = (uint64_t) addr * 8 + bit;
+	set = __flipmap_dir(fm, direction);
+	pos = __set_find(set, index >> FLIPMAP_CONTAINER_BITS, &found);
+	return found && __container_has(&set->containers[pos], index & FLIPMAP_LOW_MASK);
+}
+
+/* Mask of the bits of the byte at addr that flipped in direction. */
+uint8_t flipmap_byte(flipmap_t *fm, uintptr_t addr, int direction)
+{
+	uint8_t mask;
+	unsigned bit;
+
+	mask = 0;
+	for(bit = 0; bit < 8; ++bit) {
+		mask |= flipmap_contains(fm, addr, bit, direction) << bit;
+	}
+	return mask;
+}
+
+/* Distinct flipped bits in direction, 0 for both. */
+uint64_t flipmap_count(flipmap_t *fm, int direction)
+{
+	flipmap_set_t *set;
+	uint64_t count;
+	uint32_t i;
+	int d;
+
+	count = 0;
+	for(d = 0; d < 2; ++d) {
+		if(direction && &fm->dir[d] != __flipmap_dir(fm, direction)) {
+			continue;
+		}
+		set = &fm->dir[d];
+		for(i = 0; i < set->n; ++i) {
+			count += set->containers[i].card;
+		}
+	}
+	return count;
+}
+
+/* dst |= src, container by container. src is left as is. */
+int flipmap_merge(flipmap_t *dst, flipmap_t *src)
+{
+	flipmap_container_t *c;
+	uint32_t i;
+	int d, rv;
+
+	for(d = 0; d < 2; ++d) {
+		for(i = 0; i < src->dir[d].n; ++i) {
+			c = __set_container(&dst->dir[d], src->dir[d].containers[i].key);
+			if(c == NULL) {
+				return -ENOMEM;
+			}
+			if((rv = __container_merge(c, &src->dir[d].containers[i]))) {
+				return rv;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Call cb for every flip, by direction, then in address order. */
+void flipmap_foreach(flipmap_t *fm, flipmap_cb cb, void *arg)
+{
+	flipmap_container_t *c;
+	uint64_t index, word;
+	uint32_t i, j;
+	int d;
+
+	for(d = 0; d < 2; ++d) {
+		for(i = 0; i < fm->dir[d].n; ++i) {
+			c = &fm->dir[d].containers[i];
+			if(c->cap == 0 && c->data) {
+				for(j = 0; j < FLIPMAP_BITMAP_WORDS; ++j) {
+					for(word = ((uint64_t *) c->data)[j]; word; word &= word - 1) {
+						index = (c->key << FLIPMAP_CONTAINER_BITS) | (j * 64 + __builtin_ctzll(word));
+						cb(index / 8, index % 8, d == 0 ? ZERO_TO_ONE : ONE_TO_ZERO, arg);
+					}
+				}
+				continue;
+			}
+			for(j = 0; j < c->card; ++j) {
+				index = (c->key << FLIPMAP_CONTAINER_BITS) | ((uint16_t *) c->data)[j];
+				cb(index / 8, index % 8, d == 0 ? ZERO_TO_ONE : ONE_TO_ZERO, arg);
+			}
+		}
+	}
+}
+
+/* Heap memory held by fm. */
+size_t flipmap_bytes(flipmap_t *fm)
+{
+	flipmap_container_t *c;
+	size_t bytes;
+	uint32_t i;
+	int d;
+
+	bytes = 0;
+	for(d = 0; d < 2; ++d) {
+		bytes += fm->dir[d].cap * sizeof(flipmap_container_t);
+		for(i = 0; i < fm->dir[d].n; ++i) {
+			c = &fm->dir[d].containers[i];
+			bytes += c->cap ? c->cap * sizeof(uint16_t) : (c->data ? FLIPMAP_BITMAP_WORDS * sizeof(uint64_t) : 0);
+		}
+	}
+	return bytes;
+}
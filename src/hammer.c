@@ -0,0 +1,158 @@
+#include <sched.h>
+#include <inttypes.h>
+#include "asm.h"
+#include "timing.h"
+#include "hammer.h"
+
+int set_contains(uint8_t **array, uint64_t sz, void *elem)
+{
+    uint64_t i;
+    int rv;
+
+    rv = 0;
+    for(i = 0; i < sz; ++i) {
+        if(array[i] == (uint8_t *) elem) {
+           rv = 1;
+           goto out; 
+        }
+    }
+
+out:
+    return rv;
+}
+
+
+/* Runs activations - 1 iterations and returns that count. */
+uint64_t hammer(volatile uint8_t *a, volatile uint8_t *b, uint64_t activations)
+{
+    uint64_t n;
+
+    if(activations == 0) {
+        return 0;
+    }
+    n = activations - 1;
+    while(--activations) {
+        *a;
+        *b;
+        clflush(a);
+        clflush(b);
+    }
+    return n;
+}
+
+/* Wait for a slow access to aggressor, i.e. a refresh, so the
+   hammering starts right after one. threshold is in ns. */
+static void __ddr4_ref_sync(volatile uint8_t *aggressor, uint16_t threshold)
+{
+    uint64_t t_start, t_end;
+
+    t_start = 0;
+    t_end = 0;
+    // Is this to train the adaptive page policy?
+    sched_yield();
+    while(cycles_to_ns(tsc_elapsed(t_start, t_end)) < threshold) {
+        t_start = tsc_begin();
+        *aggressor;
+        ddr4_clflush(aggressor);
+        t_end = tsc_end();
+    }
+}
+
+/* Bank-interleaved double-sided hammering. aggressors holds
+   npairs pairs laid out as {a1, a2} per bank, all of them are
+   accessed and then flushed in one stream so the banks work in
+   parallel. Every pair still sees 2 activations per iteration,
+   which are accounted per pair in bank_acts. */
+static __always_inline void __hammer_interleaved(volatile uint8_t **aggressors, size_t npairs, uint64_t activations,
+                                                 uint64_t *bank_acts, const int ddr4)
+{
+    uint64_t i;
+    size_t j;
+
+    for(i = 0; i < activations; ++i) {
+        if(ddr4) {
+            mfence();
+        }
+        for(j = 0; j < 2 * npairs; ++j) {
+            *aggressors[j];
+        }
+        for(j = 0; j < 2 * npairs; ++j) {
+            if(ddr4) {
+                ddr4_clflush(aggressors[j]);
+            }
+            else {
+                clflush(aggressors[j]);
+            }
+        }
+    }
+
+    for(j = 0; j < npairs; ++j) {
+        bank_acts[j] += 2 * activations;
+    }
+}
+
+void hammer_interleaved(volatile uint8_t **aggressors, size_t npairs, uint64_t activations, uint64_t *bank_acts)
+{
+    __hammer_interleaved(aggressors, npairs, activations, bank_acts, 0);
+}
+
+/* Synchronised to a refresh like hammer_ddr4, so interleaved
+   rates compare with the single pair reference. */
+void hammer_interleaved_ddr4(volatile uint8_t **aggressors, size_t npairs, uint64_t activations, uint64_t *bank_acts)
+{
+    __ddr4_ref_sync(aggressors[0], DDR4_REF_SYNC_NS);
+    __hammer_interleaved(aggressors, npairs, activations, bank_acts, 1);
+}
+
+/* threshold is in ns (calibrated TSC), returns the
+   hammering time in ms. */
+uint64_t hammer_ddr4(volatile uint8_t **aggressors, size_t aggressors_sz, uint64_t nactivations, uint16_t threshold)
+{
+    uint64_t clk_start, clk_end, i;
+    size_t j;
+
+    __ddr4_ref_sync(aggressors[0], threshold);
+
+    clk_start = timing_now_ns();
+    for(i = 0; i < nactivations; ++i) {
+        mfence();
+        for(j = 0; j < aggressors_sz; ++j) {
+            *(volatile uint8_t *) aggressors[j];
+        }
+
+        for(j = 0; j < aggressors_sz; ++j) {
+            ddr4_clflush(aggressors[j]);
+        }
+    }
+
+    clk_end = timing_now_ns();
+    return ((clk_end - clk_start) / 1000000);
+}
+
+/* DDR3 backend: plain clflush hammering. */
+uint64_t hammer_ddr3_backend(volatile uint8_t **aggressors, size_t naggs, uint64_t activations)
+{
+    uint64_t i;
+    size_t j;
+
+    if(naggs == 2) {
+        return hammer(aggressors[0], aggressors[1], activations);
+    }
+
+    for(i = 0; i < activations; ++i) {
+        for(j = 0; j < naggs; ++j) {
+            *aggressors[j];
+        }
+        for(j = 0; j < naggs; ++j) {
+            clflush(aggressors[j]);
+        }
+    }
+    return activations;
+}
+
+/* DDR4 backend: clflushopt hammering synchronised to a refresh. */
+uint64_t hammer_ddr4_backend(volatile uint8_t **aggressors, size_t naggs, uint64_t activations)
+{
+    hammer_ddr4(aggressors, naggs, activations, DDR4_REF_SYNC_NS);
+    return activations;
+}
@@ -0,0 +1,1028 @@
+#include <time.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "libhammer.h"
+
+/* MEMORY MAPPING */
+#define MMAP_FLAGS  (MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED)
+#define PROT_FLAGS  (PROT_READ | PROT_WRITE)
+#define MADV_FLAGS  (MADV_HUGEPAGE)								// THPeligible
+
+static pthread_once_t timing_once = PTHREAD_ONCE_INIT;
+
+static void __timing_init_once(void)
+{
+	timing_init();
+}
+
+/* ------------------------------ CONTEXT ------------------------------ */
+
+/* Pin to the configured CPU (after the NUMA pinning narrowed the
+   allowed set), raise to SCHED_FIFO and record what we ended up with. */
+static void __ctx_exec_env(hammer_ctx_t *ctx, const hammer_config_t *conf)
+{
+	cpu_set_t allowed;
+	int cpu;
+
+	cpu = conf->cpu;
+	if(cpu == ENV_AUTO_CPU) {
+		cpu = sched_getaffinity(0, sizeof(allowed), &allowed) ? ENV_NO_CPU : env_pick_cpu(&allowed);
+	}
+	if(cpu != ENV_NO_CPU && (cpu < 0 || env_pin_cpu(cpu))) {
+		ctx->warnings |= HAMMER_WARN_CPU;
+		cpu = ENV_NO_CPU;
+	}
+	if(conf->fifo_prio && env_set_fifo(conf->fifo_prio)) {
+		ctx->warnings |= HAMMER_WARN_FIFO;
+	}
+
+	env_probe(&ctx->env, cpu);
+	if(ctx->env.governor[0] && strcmp(ctx->env.governor, "performance")) {
+		ctx->warnings |= HAMMER_WARN_GOVERNOR;
+	}
+	if(ctx->env.sibling >= 0) {
+		ctx->warnings |= HAMMER_WARN_SMT;
+	}
+}
+
+int hammer_ctx_init(hammer_ctx_t *ctx, const hammer_config_t *conf)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->conf = *conf;
+	ctx->seed = time(NULL) ^ (uintptr_t) ctx;
+
+	/* TSC calibration is process wide */
+	pthread_once(&timing_once, __timing_init_once);
+	if(!tsc_cal.invariant) {
+		ctx->warnings |= HAMMER_WARN_TSC;
+	}
+
+	if(dram_select_profile(conf->dram_gen ? conf->dram_gen : "ddr3", &ctx->dram)) {
+		return -EINVAL;
+	}
+
+	/* Row adjacency: logical unless a map was inferred for this profile */
+	rowmap_identity(&ctx->row_map, ctx->dram.name, ctx->dram.nrows);
+	if(conf->row_map_path && !conf->infer_rows) {
+		if(rowmap_load(&ctx->row_map, conf->row_map_path, ctx->dram.name, ctx->dram.nrows)) {
+			ctx->warnings |= HAMMER_WARN_ROWMAP;
+			rowmap_identity(&ctx->row_map, ctx->dram.name, ctx->dram.nrows);
+		}
+	}
+
+	numa_discover(&ctx->numa_topo);
+	if(conf->numa_node != NUMA_NO_NODE) {
+		if(numa_node_index(&ctx->numa_topo, conf->numa_node) < 0) {
+			return -ENODEV;
+		}
+		if(numa_pin_thread(&ctx->numa_topo, conf->numa_node)) {
+			ctx->warnings |= HAMMER_WARN_PIN;
+		}
+	}
+	__ctx_exec_env(ctx, conf);
+
+	/* Corrected errors are the only trace of flips on ECC memory */
+	if(edac_open(&ctx->edac, conf->edac_root) && conf->edac_root) {
+		ctx->warnings |= HAMMER_WARN_EDAC;
+	}
+
+	if(conf->perf) {
+		ctx->perf = malloc(sizeof(perf_counters_t));
+		if(ctx->perf == NULL) {
+			return -ENOMEM;
+		}
+		if(perf_open(ctx->perf)) {
+			ctx->warnings |= HAMMER_WARN_PERF;
+			free(ctx->perf);
+			ctx->perf = NULL;
+		}
+		else if(ctx->perf->nimc_cas == 0 && ctx->perf->nimc_act == 0) {
+			ctx->warnings |= HAMMER_WARN_NO_IMC;
+		}
+	}
+
+	return 0;
+}
+
+void hammer_ctx_destroy(hammer_ctx_t *ctx)
+{
+	hammer_ctx_unmap_buffers(ctx);
+	flipmap_free(&ctx->flips);
+	if(ctx->perf) {
+		perf_close(ctx->perf);
+		free(ctx->perf);
+		ctx->perf = NULL;
+	}
+}
+
+/* cb is called after every job of hammer_run_jobs(). */
+void hammer_ctx_set_callback(hammer_ctx_t *ctx, hammer_result_cb cb, void *arg)
+{
+	ctx->on_result = cb;
+	ctx->cb_arg = arg;
+}
+
+/* ---------------------------- BUFFER POOL ---------------------------- */
+
+static void __add_entropy_page(hammer_ctx_t *ctx, uint8_t *page)
+{
+	unsigned i;
+
+	for(i = 0; i < ENTROPY_PADDING_SIZE; ++i) {
+		page[i] = rand_r(&ctx->seed) % (1 << 8);
+	}
+}
+
+static void add_entropy(hammer_ctx_t *ctx, uint8_t *buf)
+{
+	unsigned i;
+
+	for(i = 0; i < BUFFER_SIZE; i += PAGE_SIZE) {
+		__add_entropy_page(ctx, buf + i);
+	}
+}
+
+/* State of the ROW_SIZE chunk holding addr, NULL outside the pool */
+static int16_t *__row_state(hammer_ctx_t *ctx, uint8_t *addr)
+{
+	unsigned b;
+
+	for(b = 0; b < ctx->nbuffers; ++b) {
+		if(addr >= ctx->buffers[b] && addr < ctx->buffers[b] + BUFFER_SIZE) {
+			return &ctx->row_state[b][(addr - ctx->buffers[b]) / ROW_SIZE];
+		}
+	}
+	return NULL;
+}
+
+static int __row_holds(const uint8_t *row, uint8_t pattern)
+{
+	unsigned j;
+
+	for(j = ENTROPY_PADDING_SIZE; j < ROW_SIZE; ++j) {
+		if(row[j] != pattern) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Row at addr was (possibly) modified outside of a job */
+void hammer_row_dirty(hammer_ctx_t *ctx, uint8_t *row)
+{
+	int16_t *state;
+
+	if((state = __row_state(ctx, row)) != NULL) {
+		*state = HAMMER_ROW_DIRTY;
+	}
+}
+
+/* Mark rows the hammering of row may have flipped as unknown */
+static void __row_touched(hammer_ctx_t *ctx, uint8_t *row)
+{
+	int16_t *state;
+
+	if((state = __row_state(ctx, row)) != NULL && *state >= 0) {
+		*state = HAMMER_ROW_UNKNOWN;
+	}
+}
+
+/* Give the payload of the row at addr pattern: nothing if it is
+   known to hold it already, a read-only check if it is unknown and
+   a rewrite otherwise. Most rows of a sweep are reused this way. */
+static void __row_restore(hammer_ctx_t *ctx, uint8_t *row, uint8_t pattern)
+{
+	int16_t *state;
+
+	state = __row_state(ctx, row);
+	if(state && *state == pattern) {
+		ctx->rows_reused++;
+		return;
+	}
+	if(state && *state == HAMMER_ROW_UNKNOWN) {
+		ctx->rows_checked++;
+		if(__row_holds(row, pattern)) {
+			*state = pattern;
+			return;
+		}
+	}
+
+	memset(row + ENTROPY_PADDING_SIZE, pattern, ROW_SIZE - ENTROPY_PADDING_SIZE);
+	ctx->rows_written++;
+	if(state) {
+		*state = pattern;
+	}
+}
+
+/* Fill a buffer with value and give every page a few
+   random bytes so KSM leaves it alone. The entropy of the
+   second page lands in the row payload, first use rewrites it. */
+void hammer_fill_buffer(hammer_ctx_t *ctx, uint8_t *buf, uint8_t value)
+{
+	unsigned r;
+
+	memset(buf, value, BUFFER_SIZE);
+	add_entropy(ctx, buf);
+	for(r = 0; r < HAMMER_ROWS_PER_BUFFER; ++r) {
+		hammer_row_dirty(ctx, buf + r * ROW_SIZE);
+	}
+}
+
+/* Map nbuffers 2MB buffers at consecutive 2MB aligned slots
+   (for THP collapsing), starting at slot first_slot. Buffers are
+   bound to the configured NUMA node, filled with 0 and get a few
+   random bytes per page so KSM leaves them alone. */
+int hammer_ctx_map_buffers(hammer_ctx_t *ctx, unsigned first_slot, unsigned nbuffers)
+{
+	uint8_t *buffer;
+	unsigned j;
+	int rv;
+
+	if(ctx->nbuffers + nbuffers > HAMMER_MAX_BUFFERS) {
+		return -ENOSPC;
+	}
+
+	for(j = 0; j < nbuffers; ++j) {
+		buffer = (uint8_t *) mmap((void *) (uintptr_t) ((first_slot + j) * BUFFER_SIZE), BUFFER_SIZE,
+								  PROT_FLAGS, MMAP_FLAGS, -1, 0);
+		if(buffer == MAP_FAILED) {
+			return -errno;
+		}
+
+		/* Enable Transparent Huge Pages (THP)
+		   and making it THPeligible. */
+		if(madvise(buffer, BUFFER_SIZE, MADV_FLAGS)) {
+			rv = -errno;
+			munmap(buffer, BUFFER_SIZE);
+			return rv;
+		}
+
+		/* Bind before the first touch, otherwise
+		   the pages are already placed. */
+		if(ctx->conf.numa_node != NUMA_NO_NODE && numa_bind_buffer(buffer, BUFFER_SIZE, ctx->conf.numa_node)) {
+			ctx->warnings |= HAMMER_WARN_MBIND;
+		}
+
+		/* Avoid swapping */
+		mlock(buffer, BUFFER_SIZE);
+
+		ctx->buffers[ctx->nbuffers++] = buffer;
+		hammer_fill_buffer(ctx, buffer, 0);
+	}
+
+	return 0;
+}
+
+void hammer_ctx_unmap_buffers(hammer_ctx_t *ctx)
+{
+	while(ctx->nbuffers) {
+		munmap(ctx->buffers[--ctx->nbuffers], BUFFER_SIZE);
+	}
+}
+
+uint8_t *hammer_ctx_buffer(hammer_ctx_t *ctx, unsigned idx)
+{
+	return idx < ctx->nbuffers ? ctx->buffers[idx] : NULL;
+}
+
+/* Check in /proc/self/smaps that the mapping holding buf is backed
+   by huge pages. Adjacent buffers share one VMA, so the whole VMA has
+   to be huge. Returns 1 if it is, 0 if not, -errno on error. */
+int hammer_buffer_is_huge(uint8_t *buf)
+{
+	char line[256];
+	uintptr_t start, end;
+	unsigned long kb;
+	int in_vma, rv;
+	FILE *fp;
+
+	fp = fopen(HAMMER_SMAPS_PATH, "r");
+	if(fp == NULL) {
+		return -errno;
+	}
+
+	rv = -ENOENT;
+	in_vma = 0;
+	start = end = 0;
+	while(fgets(line, sizeof(line), fp)) {
+		if(sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+			in_vma = (uintptr_t) buf >= start && (uintptr_t) buf < end;
+			continue;
+		}
+		if(in_vma && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+			rv = kb * 1024 >= end - start;
+			break;
+		}
+	}
+
+	fclose(fp);
+	return rv;
+}
+
+/* ----------------------------- GEOMETRY ------------------------------ */
+
+static void __dram_addr_of(hammer_ctx_t *ctx, uint8_t *addr, dram_addr_t *dram_addr)
+{
+	unsigned i;
+
+	for(i = 0; i < ctx->dram.nmasks; ++i) {
+		dram_addr->ch_to_bank[i] = __builtin_parityl((uintptr_t) addr & ctx->dram.function_masks[i]);
+	}
+	dram_addr->row = ((uintptr_t) addr & ctx->dram.row_mask) >> __builtin_ctzl(ctx->dram.row_mask);
+}
+
+/* Save the addresses which map to consecutive
+   rows of bank in addrs (dram.nrows entries). */
+void hammer_bank_rows(hammer_ctx_t *ctx, uint8_t *buf, unsigned bank, uint8_t **addrs)
+{
+	dram_addr_t dram_addr;
+	unsigned i;
+
+	for(i = 0; i < ctx->dram.nmasks; ++i) {
+		dram_addr.ch_to_bank[i] = (bank & (1 << i)) > 0 ? 1 : 0;
+	}
+
+	for(i = 0; i < ctx->dram.nrows; ++i) {
+		dram_addr.row = i;
+		addrs[i] = (uint8_t *) ((uintptr_t) dram_to_physical(&ctx->dram, dram_addr) | (uintptr_t) buf);
+	}
+}
+
+uintptr_t hammer_row_align(hammer_ctx_t *ctx, uint8_t *buf, uint8_t *addr)
+{
+	dram_addr_t dram_addr;
+
+	__dram_addr_of(ctx, addr, &dram_addr);
+	return (uintptr_t) buf | dram_to_physical(&ctx->dram, dram_addr);
+}
+
+uintptr_t hammer_adjacent_row(hammer_ctx_t *ctx, uint8_t *buf, uint8_t *addr, int placement)
+{
+	dram_addr_t dram_addr;
+	int16_t neighbour;
+
+	__dram_addr_of(ctx, addr, &dram_addr);
+
+	/* Physical neighbour from the row map if we know it */
+	neighbour = dram_addr.row < ctx->row_map.nrows ?
+				ctx->row_map.neighbours[dram_addr.row][placement == PREV_ROW ? 0 : 1] : ROWMAP_NO_ROW;
+	if(neighbour >= 0 && (unsigned) neighbour < ctx->dram.nrows) {
+		dram_addr.row = neighbour;
+	}
+	else if(placement == PREV_ROW) {
+		dram_addr.row--;
+	}
+	else {
+		dram_addr.row++;
+	}
+
+	return (uintptr_t) buf | dram_to_physical(&ctx->dram, dram_addr);
+}
+
+/* ------------------------------- JOBS -------------------------------- */
+
+/* All the A-V-A triplets of a bank: aggressors 0xFF, victim 0x00. */
+size_t hammer_bank_jobs(hammer_ctx_t *ctx, unsigned buffer, unsigned bank, hammer_job_t *jobs, size_t max)
+{
+	unsigned i, a1, a2;
+	size_t n;
+
+	n = 0;
+	for(i = 0; i + 4 < ctx->dram.nrows && n < max; ++i) {
+		if(rowmap_aggressors(&ctx->row_map, i + 1, &a1, &a2)) {
+			continue;
+		}
+		memset(&jobs[n], 0, sizeof(hammer_job_t));
+		jobs[n].buffer = buffer;
+		jobs[n].bank = bank;
+		jobs[n].victim_row = i + 1;
+		jobs[n].agg_rows[0] = HAMMER_ROW_MAP;
+		jobs[n].agg_rows[1] = HAMMER_ROW_MAP;
+		jobs[n].agg_pattern = 0xFF;
+		jobs[n].victim_pattern = 0x00;
+		++n;
+	}
+
+	return n;
+}
+
+/* A triplet around a random row of a random bank: aggressors 0x00, victim 0xFF. */
+void hammer_random_job(hammer_ctx_t *ctx, unsigned buffer, hammer_job_t *job)
+{
+	memset(job, 0, sizeof(hammer_job_t));
+	job->buffer = buffer;
+	job->bank = rand_r(&ctx->seed) % (1 << ctx->dram.nmasks);
+	job->victim_row = rand_r(&ctx->seed) % ctx->dram.nrows;
+	job->agg_rows[0] = HAMMER_ROW_MAP;
+	job->agg_rows[1] = HAMMER_ROW_MAP;
+	job->agg_pattern = 0x00;
+	job->victim_pattern = 0xFF;
+}
+
+/* Logical rows up to radius physical rows away from either
+   aggressor, walking the row map outwards from both. Fills rows
+   nearest first with dist[] set for them, returns their number. */
+static unsigned __row_distances(hammer_ctx_t *ctx, const unsigned *aggs, unsigned radius,
+		unsigned *rows, int *dist)
+{
+	unsigned head, tail, r, n;
+	int next;
+
+	for(r = 0; r < ctx->dram.nrows; ++r) {
+		dist[r] = -1;
+	}
+
+	head = tail = 0;
+	dist[aggs[0]] = 0;
+	rows[tail++] = aggs[0];
+	if(dist[aggs[1]] < 0) {
+		dist[aggs[1]] = 0;
+		rows[tail++] = aggs[1];
+	}
+
+	while(head < tail) {
+		r = rows[head++];
+		if((unsigned) dist[r] == radius) {
+			continue;
+		}
+		for(n = 0; n < 2; ++n) {
+			next = ctx->row_map.neighbours[r][n];
+			if(next != ROWMAP_NO_ROW && (unsigned) next < ctx->dram.nrows && dist[next] < 0) {
+				dist[next] = dist[r] + 1;
+				rows[tail++] = next;
+			}
+		}
+	}
+	return tail;
+}
+
+/* Rows up to blast_radius physical rows away from either aggressor.
+   Aggressors are listed at distance 0, every other row gets the
+   victim pattern. */
+static void __blast_rows(hammer_ctx_t *ctx, uint8_t **addrs, hammer_result_t *result, uint8_t agg_pattern)
+{
+	unsigned rows[MAX_CONTROLLED_ROWS], aggs[2], radius, nrows, i, r;
+	int dist[MAX_CONTROLLED_ROWS];
+	hammer_blast_row_t *blast;
+
+	radius = ctx->conf.blast_radius < HAMMER_MAX_RADIUS ? ctx->conf.blast_radius : HAMMER_MAX_RADIUS;
+	aggs[0] = result->rows[0];
+	aggs[1] = result->rows[2];
+	nrows = __row_distances(ctx, aggs, radius, rows, dist);
+
+	for(i = 0; i < nrows; ++i) {
+		r = rows[i];
+		if(r != result->rows[1] && result->nblast < HAMMER_MAX_BLAST) {
+			blast = &result->blast[result->nblast++];
+			blast->row = addrs[r];
+			blast->logical = r;
+			blast->distance = dist[r];
+			blast->pattern = dist[r] ? result->victim_pattern : agg_pattern;
+			if(dist[r]) {
+				__row_restore(ctx, blast->row, blast->pattern);
+			}
+		}
+	}
+}
+
+/* Resolve the rows of a job and write the data patterns. */
+static int __prepare_job(hammer_ctx_t *ctx, const hammer_job_t *job, hammer_result_t *result)
+{
+	uint8_t *addrs[MAX_CONTROLLED_ROWS];
+	unsigned a1, a2;
+
+	memset(result, 0, sizeof(hammer_result_t));
+	result->buffer = job->buffer;
+	result->bank = job->bank;
+	result->agg_pattern = job->agg_pattern;
+	result->victim_pattern = job->victim_pattern;
+
+	if(job->buffer >= ctx->nbuffers || job->bank >= (1U << ctx->dram.nmasks) || job->victim_row >= ctx->dram.nrows) {
+		return (result->status = -EINVAL);
+	}
+
+	if(job->agg_rows[0] == HAMMER_ROW_MAP || job->agg_rows[1] == HAMMER_ROW_MAP) {
+		if(rowmap_aggressors(&ctx->row_map, job->victim_row, &a1, &a2)) {
+			return (result->status = -EINVAL);
+		}
+	}
+	else {
+		a1 = job->agg_rows[0];
+		a2 = job->agg_rows[1];
+	}
+	if(a1 >= ctx->dram.nrows || a2 >= ctx->dram.nrows) {
+		return (result->status = -EINVAL);
+	}
+
+	hammer_bank_rows(ctx, ctx->buffers[job->buffer], job->bank, addrs);
+	result->rows[0] = a1;
+	result->rows[1] = job->victim_row;
+	result->rows[2] = a2;
+	result->agg1 = addrs[a1];
+	result->victim = addrs[job->victim_row];
+	result->agg2 = addrs[a2];
+
+	__row_restore(ctx, result->agg1, job->agg_pattern);
+	__row_restore(ctx, result->agg2, job->agg_pattern);
+	__row_restore(ctx, result->victim, job->victim_pattern);
+	if(ctx->conf.blast_radius) {
+		__blast_rows(ctx, addrs, result, job->agg_pattern);
+	}
+
+	return 0;
+}
+
+/* Count the flipped bits of row per direction into to_1/to_0, keep
+   flipped bytes while result has room and add all of them to fm. */
+static int __scan_row(hammer_result_t *result, uint8_t *row, uint8_t expected, uint8_t distance,
+		uint64_t *to_1, uint64_t *to_0, flipmap_t *fm)
+{
+	uint8_t observed, diff;
+	unsigned j;
+	int rv;
+
+	rv = 0;
+	for(j = ENTROPY_PADDING_SIZE; j < ROW_SIZE; ++j) {
+		observed = row[j];
+		if((diff = observed ^ expected) == 0) {
+			continue;
+		}
+
+		*to_1 += __builtin_popcount(diff & observed);
+		*to_0 += __builtin_popcount(diff & expected);
+		if(result->nrecorded < HAMMER_MAX_FLIPS) {
+			result->recorded[result->nrecorded].addr = (uintptr_t) (row + j);
+			result->recorded[result->nrecorded].expected = expected;
+			result->recorded[result->nrecorded].observed = observed;
+			result->recorded[result->nrecorded].distance = distance;
+			result->nrecorded++;
+		}
+		if(fm && flipmap_add_byte(fm, (uintptr_t) (row + j), expected, observed) < 0) {
+			rv = -ENOMEM;
+		}
+	}
+	return rv;
+}
+
+/* Count the flipped bits of the victim row per direction, keep the
+   first HAMMER_MAX_FLIPS flipped bytes and add all of them to fm if
+   given. Returns -ENOMEM if fm could not take every flip, else 0. */
+int hammer_scan_victim(hammer_result_t *result, flipmap_t *fm)
+{
+	uint64_t to_1, to_0;
+	int rv;
+
+	to_1 = to_0 = 0;
+	rv = __scan_row(result, result->victim, result->victim_pattern, 1, &to_1, &to_0, fm);
+	result->flips += to_1 + to_0;
+	result->flips_0_to_1 += to_1;
+	result->flips_1_to_0 += to_0;
+	return rv;
+}
+
+/* Write back and evict the payload of rows, one fence for all of
+   them. Freshly written rows would otherwise sit in the cache while
+   the aggressors are hammered and be scanned from there. */
+void hammer_flush_rows(uint8_t **rows, unsigned nrows)
+{
+	unsigned i, j;
+
+	for(i = 0; i < nrows; ++i) {
+		for(j = 0; j < ROW_SIZE; j += CACHE_LINE_SIZE) {
+			clflush(rows[i] + j);
+		}
+	}
+	mfence();
+}
+
+static __always_inline uint64_t __time_load(volatile uint8_t *addr)
+{
+	uint64_t t_start;
+
+	t_start = tsc_begin();
+	(void) *addr;
+	return tsc_elapsed(t_start, tsc_end());
+}
+
+static int __cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Midway between the median cached and uncached load of line.
+   Stays 0 where the two can't be told apart, probes then never
+   count a row as cached. */
+static void __calibrate_cache(hammer_ctx_t *ctx, volatile uint8_t *line)
+{
+	uint64_t hit[HAMMER_CACHE_SAMPLES], miss[HAMMER_CACHE_SAMPLES];
+	unsigned i;
+
+	for(i = 0; i < HAMMER_CACHE_SAMPLES; ++i) {
+		(void) *line;
+		hit[i] = __time_load(line);
+		clflush(line);
+		mfence();
+		miss[i] = __time_load(line);
+	}
+	qsort(hit, HAMMER_CACHE_SAMPLES, sizeof(uint64_t), __cmp_u64);
+	qsort(miss, HAMMER_CACHE_SAMPLES, sizeof(uint64_t), __cmp_u64);
+	hit[0] = hit[HAMMER_CACHE_SAMPLES / 2];
+	miss[0] = miss[HAMMER_CACHE_SAMPLES / 2];
+	ctx->cache_hit_cycles = miss[0] > 2 * hit[0] ? (hit[0] + miss[0]) / 2 : 0;
+	ctx->cache_calibrated = 1;
+}
+
+/* Time the first line of every page of each row, last page first
+   (ascending probes make the prefetchers pull in the next ones),
+   then flush the rows so the scan reads DRAM. Returns how many rows
+   had a line cached. */
+unsigned hammer_uncache_rows(hammer_ctx_t *ctx, uint8_t **rows, unsigned nrows)
+{
+	unsigned i, cached;
+	int p;
+
+	if(nrows == 0) {
+		return 0;
+	}
+	if(!ctx->cache_calibrated) {
+		__calibrate_cache(ctx, rows[0]);
+		hammer_flush_rows(rows, 1);
+	}
+
+	cached = 0;
+	for(i = 0; i < nrows; ++i) {
+		for(p = ROW_SIZE / PAGE_SIZE - 1; p >= 0; --p) {
+			if(__time_load(rows[i] + p * PAGE_SIZE) < ctx->cache_hit_cycles) {
+				cached++;
+				break;
+			}
+		}
+	}
+	hammer_flush_rows(rows, nrows);
+	ctx->rows_probed += nrows;
+	ctx->rows_cached += cached;
+	return cached;
+}
+
+/* Victim and blast rows of a result, the rows its scan reads */
+static unsigned __scanned_rows(const hammer_result_t *result, uint8_t **rows)
+{
+	unsigned i;
+
+	rows[0] = result->victim;
+	for(i = 0; i < result->nblast; ++i) {
+		rows[i + 1] = result->blast[i].row;
+	}
+	return result->nblast + 1;
+}
+
+/* Scan the blast rows after the victim. Their flips only go to
+   flips_at[], flips and the per direction counts stay the victim's. */
+static int __scan_blast(hammer_result_t *result, flipmap_t *fm)
+{
+	hammer_blast_row_t *blast;
+	uint64_t to_1, to_0;
+	unsigned i;
+	int rv;
+
+	rv = 0;
+	result->flips_at[1] += result->flips;
+	for(i = 0; i < result->nblast; ++i) {
+		blast = &result->blast[i];
+		to_1 = to_0 = 0;
+		if(__scan_row(result, blast->row, blast->pattern, blast->distance, &to_1, &to_0, fm)) {
+			rv = -ENOMEM;
+		}
+		blast->flips = to_1 + to_0;
+		result->flips_at[blast->distance] += blast->flips;
+	}
+	return rv;
+}
+
+/* Number of jobs from the start of jobs[] which can share one
+   bank-interleaved stream: same buffer, rows, patterns and
+   amount of hammering, all in different banks. */
+static size_t __job_group(hammer_ctx_t *ctx, const hammer_job_t *jobs, size_t njobs)
+{
+	size_t n, k, max;
+
+	max = ctx->conf.interleave_banks;
+	if(max > MAX_CONTROLLED_BANKS) {
+		max = MAX_CONTROLLED_BANKS;
+	}
+
+	for(n = 1; n < njobs && n < max; ++n) {
+		if(jobs[n].buffer != jobs[0].buffer || jobs[n].victim_row != jobs[0].victim_row ||
+		   jobs[n].agg_rows[0] != jobs[0].agg_rows[0] || jobs[n].agg_rows[1] != jobs[0].agg_rows[1] ||
+		   jobs[n].agg_pattern != jobs[0].agg_pattern || jobs[n].victim_pattern != jobs[0].victim_pattern ||
+		   jobs[n].activations != jobs[0].activations || jobs[n].rounds != jobs[0].rounds) {
+			break;
+		}
+		for(k = 0; k < n; ++k) {
+			if(jobs[k].bank == jobs[n].bank) {
+				return n;
+			}
+		}
+	}
+
+	return n;
+}
+
+/* Aggressors are only read. The scans tell whether the victim and
+   blast rows still hold their pattern, any other row up to
+   HAMMER_MAX_RADIUS away (half-double reaches past the neighbours)
+   may have flipped unseen. */
+static void __rows_hammered(hammer_ctx_t *ctx, const hammer_result_t *result)
+{
+	unsigned rows[MAX_CONTROLLED_ROWS], aggs[2], nrows, i;
+	uint8_t *addrs[MAX_CONTROLLED_ROWS];
+	int dist[MAX_CONTROLLED_ROWS];
+	int16_t *state;
+
+	hammer_bank_rows(ctx, ctx->buffers[result->buffer], result->bank, addrs);
+	aggs[0] = result->rows[0];
+	aggs[1] = result->rows[2];
+	nrows = __row_distances(ctx, aggs, HAMMER_MAX_RADIUS, rows, dist);
+	for(i = 0; i < nrows; ++i) {
+		if(dist[rows[i]] > 0) {
+			__row_touched(ctx, addrs[rows[i]]);
+		}
+	}
+	if((state = __row_state(ctx, result->victim)) != NULL) {
+		*state = result->flips ? HAMMER_ROW_DIRTY : result->victim_pattern;
+	}
+	for(i = 0; i < result->nblast; ++i) {
+		if((state = __row_state(ctx, result->blast[i].row)) != NULL) {
+			*state = result->blast[i].flips ? HAMMER_ROW_DIRTY : result->blast[i].pattern;
+		}
+	}
+}
+
+static void __run_group(hammer_ctx_t *ctx, const hammer_job_t *jobs, size_t njobs, hammer_result_t *results)
+{
+	volatile uint8_t *aggs[2 * MAX_CONTROLLED_BANKS];
+	uint64_t bank_acts[MAX_CONTROLLED_BANKS];
+	uint8_t *rows[MAX_CONTROLLED_BANKS * (3 + HAMMER_MAX_BLAST)];
+	uint64_t activations, rounds, iterations, t_start, t_delta, r, n;
+	unsigned slot[MAX_CONTROLLED_BANKS];
+	edac_counts_t edac_before, edac_after;
+	edac_delta_t edac;
+	perf_sample_t sample;
+	uint64_t load_before;
+	double load_mbps;
+	unsigned nrows;
+	size_t k, m;
+	int have_edac;
+
+	m = 0;
+	for(k = 0; k < njobs; ++k) {
+		if(__prepare_job(ctx, &jobs[k], &results[k])) {
+			continue;
+		}
+		aggs[2 * m] = results[k].agg1;
+		aggs[2 * m + 1] = results[k].agg2;
+		bank_acts[m] = 0;
+		slot[m++] = k;
+	}
+	if(m == 0) {
+		return;
+	}
+	stats_job(ctx->stats, jobs[slot[0]].buffer, jobs[slot[0]].bank, jobs[slot[0]].victim_row);
+
+	/* Patterns go to DRAM before the first activation, the
+	   aggressors' too (blast rows include them already) */
+	for(k = 0, nrows = 0; k < m; ++k) {
+		nrows += __scanned_rows(&results[slot[k]], rows + nrows);
+		if(results[slot[k]].nblast == 0) {
+			rows[nrows++] = results[slot[k]].agg1;
+			rows[nrows++] = results[slot[k]].agg2;
+		}
+	}
+	hammer_flush_rows(rows, nrows);
+
+	activations = jobs[0].activations ? jobs[0].activations : ctx->conf.num_row_activations;
+	rounds = jobs[0].rounds ? jobs[0].rounds : ctx->conf.hammering_rounds;
+
+	have_edac = ctx->edac.nmcs && edac_snapshot(&ctx->edac, &edac_before) == 0;
+	load_before = ctx->load ? load_bytes(ctx->load) : 0;
+	if(ctx->perf) {
+		perf_begin(ctx->perf, timing_now_ns());
+	}
+	t_start = timing_now_ns();
+	for(r = 0, iterations = 0; r < rounds; ++r) {
+		if(m == 1) {
+			n = ctx->dram.hammer(aggs, 2, activations);
+			bank_acts[0] += 2 * n;
+			iterations += n;
+		}
+		else {
+			ctx->dram.hammer_interleaved(aggs, m, activations, bank_acts);
+			iterations += activations;
+		}
+	}
+	t_delta = timing_now_ns() - t_start;
+	stats_phase(ctx->stats, STATS_SCAN);
+	/* bytes / ns * 1e3 is MB/s */
+	load_mbps = ctx->load && t_delta ? (load_bytes(ctx->load) - load_before) * 1e3 / t_delta : 0;
+	if(ctx->perf) {
+		perf_end(ctx->perf, timing_now_ns(), iterations, iterations * 2 * m, &sample);
+	}
+	if(have_edac && edac_snapshot(&ctx->edac, &edac_after) == 0) {
+		edac_delta(&ctx->edac, &edac_before, &edac_after, &edac);
+	}
+	else {
+		have_edac = 0;
+	}
+
+	for(k = 0; k < m; ++k) {
+		hammer_result_t *result = &results[slot[k]];
+
+		result->activations = bank_acts[k];
+		result->elapsed_ns = t_delta;
+		result->acts_per_sec = t_delta ? bank_acts[k] * 1e9 / t_delta : 0;
+		result->interleaved = m;
+		result->load_mbps = load_mbps;
+		if(ctx->perf) {
+			result->have_perf = 1;
+			result->perf = sample;
+		}
+		if(have_edac) {
+			result->have_edac = 1;
+			result->edac = edac;
+		}
+		nrows = __scanned_rows(result, rows);
+		result->cached = hammer_uncache_rows(ctx, rows, nrows);
+		if(hammer_scan_victim(result, &ctx->flips)) {
+			ctx->warnings |= HAMMER_WARN_FLIPMAP;
+		}
+		if(__scan_blast(result, &ctx->flips)) {
+			ctx->warnings |= HAMMER_WARN_FLIPMAP;
+		}
+		__rows_hammered(ctx, result);
+		stats_result(ctx->stats, result->flips, result->activations, result->acts_per_sec);
+	}
+	stats_phase(ctx->stats, STATS_SWEEP);
+}
+
+/* Run njobs jobs, results[i] belongs to jobs[i]. With interleave_banks
+   set, consecutive jobs differing only in the bank share one stream.
+   Returns the number of jobs run, failed jobs carry their status. */
+int hammer_run_jobs(hammer_ctx_t *ctx, const hammer_job_t *jobs, size_t njobs, hammer_result_t *results)
+{
+	size_t i, n, k;
+
+	for(i = 0; i < njobs; i += n) {
+		n = __job_group(ctx, jobs + i, njobs - i);
+		__run_group(ctx, jobs + i, n, results + i);
+		for(k = 0; k < n && ctx->on_result; ++k) {
+			ctx->on_result(ctx, &results[i + k], ctx->cb_arg);
+		}
+	}
+
+	return njobs;
+}
+
+/* ----------------------------- LOW LEVEL ----------------------------- */
+
+/* Double-sided hammering of a and b with the profile's kernel. Fills
+   sample and returns 1 if counters are on, 0 otherwise. */
+int hammer_pair(hammer_ctx_t *ctx, volatile uint8_t *a, volatile uint8_t *b, uint64_t activations, perf_sample_t *sample)
+{
+	volatile uint8_t *aggressors[2] = {a, b};
+	uint64_t n;
+
+	if(ctx->perf) {
+		perf_begin(ctx->perf, timing_now_ns());
+	}
+	n = ctx->dram.hammer(aggressors, 2, activations);
+	if(ctx->perf) {
+		perf_end(ctx->perf, timing_now_ns(), n, 2 * n, sample);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* ACT/s of a single double-sided pair in bank 0, the first one
+   hammer_bank_jobs would pick, the reference the interleaved
+   per-bank rates are held to. */
+double hammer_reference_rate(hammer_ctx_t *ctx, unsigned buffer)
+{
+	volatile uint8_t *aggressors[2];
+	uint8_t *addrs[MAX_CONTROLLED_ROWS];
+	unsigned rows[MAX_CONTROLLED_ROWS], aggs[2], v, nrows, i;
+	int dist[MAX_CONTROLLED_ROWS];
+	uint64_t t_start, t_delta, n;
+
+	if(buffer >= ctx->nbuffers) {
+		return 0;
+	}
+	for(v = 1; v < ctx->dram.nrows; ++v) {
+		if(rowmap_aggressors(&ctx->row_map, v, &aggs[0], &aggs[1]) == 0) {
+			break;
+		}
+	}
+	if(v == ctx->dram.nrows) {
+		return 0;
+	}
+
+	hammer_bank_rows(ctx, ctx->buffers[buffer], 0, addrs);
+	aggressors[0] = addrs[aggs[0]];
+	aggressors[1] = addrs[aggs[1]];
+	t_start = timing_now_ns();
+	n = ctx->dram.hammer(aggressors, 2, ctx->conf.num_row_activations);
+	t_delta = timing_now_ns() - t_start;
+	nrows = __row_distances(ctx, aggs, HAMMER_MAX_RADIUS, rows, dist);
+	for(i = 0; i < nrows; ++i) {
+		__row_touched(ctx, addrs[rows[i]]);
+	}
+
+	return t_delta ? (2.0 * n) * 1e9 / t_delta : 0;
+}
+
+/* ------------------------- ROW MAP INFERENCE ------------------------- */
+
+/* Single-sided hammering of every row of bank against far away
+   dummy rows of the same bank. evidence[a][r] counts the bits of row r
+   flipped by aggressor a. Only flips seen with every dummy count, the
+   ones caused by a dummy's own neighbours don't survive the minimum. */
+static void infer_bank_rows(hammer_ctx_t *ctx, uint8_t *buf, unsigned bank, uint64_t evidence[][ROWMAP_MAX_ROWS])
+{
+	volatile uint8_t *aggressors[2];
+	uint8_t *addrs[MAX_CONTROLLED_ROWS];
+	uint64_t flips[ROWMAP_DUMMIES][MAX_CONTROLLED_ROWS], min;
+	unsigned a, d, r, j, k, dummy, nrows;
+
+	nrows = ctx->dram.nrows;
+	hammer_bank_rows(ctx, buf, bank, addrs);
+
+	for(a = 0; a < nrows; ++a) {
+		for(d = 0; d < ROWMAP_DUMMIES; ++d) {
+			dummy = (a + (d + 1) * nrows / (ROWMAP_DUMMIES + 1)) % nrows;
+			for(r = 0; r < nrows; ++r) {
+				__row_restore(ctx, addrs[r], (r == a || r == dummy) ? 0xFF : 0x00);
+			}
+
+			aggressors[0] = addrs[a];
+			aggressors[1] = addrs[dummy];
+			for(k = 0; k < ctx->conf.hammering_rounds; k++) {
+				ctx->dram.hammer(aggressors, 2, ctx->conf.num_row_activations);
+			}
+
+			for(r = 0; r < nrows; ++r) {
+				flips[d][r] = 0;
+				if(r == a || r == dummy) {
+					continue;
+				}
+				for(j = ENTROPY_PADDING_SIZE; j < ROW_SIZE; ++j) {
+					flips[d][r] += __builtin_popcount(addrs[r][j]);
+				}
+				if(flips[d][r]) {
+					hammer_row_dirty(ctx, addrs[r]);
+				}
+			}
+		}
+
+		for(r = 0; r < nrows; ++r) {
+			min = flips[0][r];
+			for(d = 1; d < ROWMAP_DUMMIES; ++d) {
+				min = flips[d][r] < min ? flips[d][r] : min;
+			}
+			evidence[a][r] += min;
+		}
+	}
+}
+
+/* Infer the logical -> physical row adjacency of the profile in
+   buffer (bank -1 for all banks) and save it to the row map file. */
+int hammer_infer_row_map(hammer_ctx_t *ctx, unsigned buffer, int bank)
+{
+	static __thread uint64_t evidence[ROWMAP_MAX_ROWS][ROWMAP_MAX_ROWS];
+	unsigned b;
+
+	if(buffer >= ctx->nbuffers) {
+		return -EINVAL;
+	}
+
+	memset(evidence, 0, sizeof(evidence));
+	for(b = 0; b < ctx->dram.nbanks; ++b) {
+		if(bank != -1 && b != (unsigned) bank) {
+			continue;
+		}
+		infer_bank_rows(ctx, ctx->buffers[buffer], b, evidence);
+	}
+
+	rowmap_identity(&ctx->row_map, ctx->dram.name, ctx->dram.nrows);
+	rowmap_from_evidence(&ctx->row_map, evidence);
+
+	if(rowmap_save(&ctx->row_map, ctx->conf.row_map_path ? ctx->conf.row_map_path : ROWMAP_DEFAULT_PATH)) {
+		return -errno;
+	}
+	return 0;
+}
@@ -0,0 +1,193 @@
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "load.h"
+#include "util.h"
+#include "timing.h"
+
+/* CPUs of the node (all allowed ones without a node) minus
+   the hammering CPU, unless that would leave none. */
+static void __load_affinity(load_t *load)
+{
+	cpu_set_t set;
+	int idx;
+
+	if(load->node != NUMA_NO_NODE && (idx = numa_node_index(load->topo, load->node)) >= 0) {
+		set = load->topo->cpus[idx];
+	}
+	else if(sched_getaffinity(0, sizeof(cpu_set_t), &set)) {
+		return;
+	}
+	if(load->avoid_cpu >= 0 && CPU_ISSET(load->avoid_cpu, &set) && CPU_COUNT(&set) > 1) {
+		CPU_CLR(load->avoid_cpu, &set);
+	}
+	sched_setaffinity(0, sizeof(cpu_set_t), &set);
+}
+
+static void *load_thread_run(void *arg)
+{
+	uint64_t nlines, line, bytes, t_start, due;
+	struct timespec ts;
+	load_thread_t *thread;
+	load_t *load;
+	unsigned i;
+
+	thread = (load_thread_t *) arg;
+	load = thread->load;
+	__load_affinity(load);
+
+	nlines = LOAD_BUFFER_SIZE / LOAD_LINE_SIZE;
+	line = 0;
+	bytes = 0;
+	t_start = timing_now_ns();
+	while(!load->stop) {
+		for(i = 0; i < LOAD_STEP_LINES; ++i) {
+			if(load->pattern == LOAD_RANDOM) {
+				line = xorshift64(&thread->seed) % nlines;
+			}
+			else {
+				line = line + 1 < nlines ? line + 1 : 0;
+			}
+			(*(volatile uint64_t *) (thread->buf + line * LOAD_LINE_SIZE))++;
+		}
+		/* A dirtied line is read and written back */
+		bytes += LOAD_STEP_LINES * 2 * LOAD_LINE_SIZE;
+		__atomic_store_n(&thread->bytes, bytes, __ATOMIC_RELAXED);
+
+		if(load->mbps > 0) {
+			/* bytes / (MB/s) in ns */
+			due = t_start + bytes * 1e3 / (load->mbps / load->nthreads);
+			if(due > timing_now_ns() + 1000) {
+				due -= timing_now_ns();
+				ts.tv_sec = due / 1000000000UL;
+				ts.tv_nsec = due % 1000000000UL;
+				nanosleep(&ts, NULL);
+			}
+		}
+	}
+	return NULL;
+}
+
+/* threads[,MB/s[,stream|random[,node]]], MB/s of 0 is unthrottled. */
+int load_parse(load_t *load, const char *spec)
+{
+	char buf[128], *field, *save;
+	unsigned n;
+
+	memset(load, 0, sizeof(load_t));
+	load->pattern = LOAD_STREAM;
+	load->node = NUMA_NO_NODE;
+	load->avoid_cpu = -1;
+
+	strncpy(buf, spec, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	for(n = 0, field = strtok_r(buf, ",", &save); field; ++n, field = strtok_r(NULL, ",", &save)) {
+		switch(n) {
+			case 0:
+				load->nthreads = atoi(field);
+				break;
+			case 1:
+				load->mbps = atof(field);
+				break;
+			case 2:
+				if(strcmp(field, "stream") == 0) {
+					load->pattern = LOAD_STREAM;
+				}
+				else if(strcmp(field, "random") == 0) {
+					load->pattern = LOAD_RANDOM;
+				}
+				else {
+					return -EINVAL;
+				}
+				break;
+			case 3:
+				load->node = atoi(field);
+				break;
+			default:
+				return -EINVAL;
+		}
+	}
+	if(load->nthreads == 0 || load->nthreads > LOAD_MAX_THREADS || load->mbps < 0) {
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/* Map, bind and touch the buffers, then start the threads and
+   wait until all of them move data. A failure stops the threads
+   already running. */
+int load_start(load_t *load, numa_topology_t *topo, int avoid_cpu)
+{
+	load_thread_t *thread;
+	unsigned i;
+	int rv;
+
+	load->topo = topo;
+	load->avoid_cpu = avoid_cpu;
+	load->stop = 0;
+	load->nstarted = 0;
+	if(load->node != NUMA_NO_NODE && numa_node_index(topo, load->node) < 0) {
+		return -ENODEV;
+	}
+
+	for(i = 0; i < load->nthreads; ++i) {
+		thread = &load->threads[i];
+		thread->load = load;
+		thread->bytes = 0;
+		thread->seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+		thread->buf = mmap(NULL, LOAD_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(thread->buf == MAP_FAILED) {
+			rv = -errno;
+			goto out;
+		}
+		if(load->node != NUMA_NO_NODE) {
+			numa_bind_buffer(thread->buf, LOAD_BUFFER_SIZE, load->node);
+		}
+		memset(thread->buf, 0, LOAD_BUFFER_SIZE);
+		if((rv = -pthread_create(&thread->tid, NULL, load_thread_run, thread))) {
+			munmap(thread->buf, LOAD_BUFFER_SIZE);
+			goto out;
+		}
+		load->nstarted++;
+	}
+
+	/* Measurements right after us should see the load */
+	for(i = 0; i < load->nstarted; ++i) {
+		while(__atomic_load_n(&load->threads[i].bytes, __ATOMIC_RELAXED) == 0) {
+			sched_yield();
+		}
+	}
+	return 0;
+
+out:
+	load_stop(load);
+	return rv;
+}
+
+void load_stop(load_t *load)
+{
+	unsigned i;
+
+	load->stop = 1;
+	for(i = 0; i < load->nstarted; ++i) {
+		pthread_join(load->threads[i].tid, NULL);
+		munmap(load->threads[i].buf, LOAD_BUFFER_SIZE);
+	}
+	load->nstarted = 0;
+}
+
+/* Bytes moved by all threads so far. */
+uint64_t load_bytes(load_t *load)
+{
+	uint64_t bytes;
+	unsigned i;
+
+	bytes = 0;
+	for(i = 0; i < load->nstarted; ++i) {
+		bytes += __atomic_load_n(&load->threads[i].bytes, __ATOMIC_RELAXED);
+	}
+	return bytes;
+}
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "metrics.h"
+
+static const char *phase_names[METRICS_PHASES] = {"setup", "check", "sweep", "done"};
+
+/* Counters start at zero in METRICS_SETUP, nothing is written until
+   the first metrics_write() or result past METRICS_INTERVAL_NS. */
+void metrics_init(metrics_t *m, const char *path)
+{
+	memset(m, 0, sizeof(metrics_t));
+	pthread_mutex_init(&m->lock, NULL);
+	m->path = path;
+	m->phase = METRICS_SETUP;
+	m->phase_start_ns = timing_now_ns();
+	m->last_write_ns = m->phase_start_ns;
+}
+
+static void __metrics_phase(metrics_t *m, unsigned phase)
+{
+	uint64_t now;
+
+	now = timing_now_ns();
+	m->phase_seconds[m->phase] += (now - m->phase_start_ns) / 1e9;
+	m->phase_start_ns = now;
+	m->phase = phase;
+}
+
+/* Account the time so far to the current phase and switch to phase.
+   profile is the DRAM profile name once it is known, else NULL. */
+void metrics_phase(metrics_t *m, unsigned phase, const char *profile)
+{
+	pthread_mutex_lock(&m->lock);
+	if(profile) {
+		strncpy(m->profile, profile, ROWMAP_PROFILE_LEN - 1);
+	}
+	__metrics_phase(m, phase);
+	pthread_mutex_unlock(&m->lock);
+}
+
+/* A buffer setup: mapped or failed, and if mapped huge page backed. */
+void metrics_buffer(metrics_t *m, int mapped, int huge)
+{
+	pthread_mutex_lock(&m->lock);
+	if(mapped) {
+		m->buffers_mapped++;
+		m->buffers_huge += !!huge;
+	}
+	else {
+		m->buffer_failures++;
+	}
+	pthread_mutex_unlock(&m->lock);
+}
+
+static void __metrics_print(FILE *fp, void *arg)
+{
+	double phase_seconds[METRICS_PHASES];
+	metrics_t *m = arg;
+	unsigned i, b;
+
+	/* The current phase so far, without closing it */
+	memcpy(phase_seconds, m->phase_seconds, sizeof(phase_seconds));
+	phase_seconds[m->phase] += (timing_now_ns() - m->phase_start_ns) / 1e9;
+
+	fprintf(fp, "# HELP " METRICS_PREFIX "info DRAM profile of the run.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "info gauge\n");
+	fprintf(fp, METRICS_PREFIX "info{profile=\"%s\"} 1\n", m->profile[0] ? m->profile : "unknown");
+
+	fprintf(fp, "# HELP " METRICS_PREFIX "phase Phase the run is in.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "phase gauge\n");
+	for(i = 0; i < METRICS_PHASES; ++i) {
+		fprintf(fp, METRICS_PREFIX "phase{phase=\"%s\"} %d\n", phase_names[i], m->phase == i);
+	}
+	fprintf(fp, "# HELP " METRICS_PREFIX "phase_seconds_total Wall time spent in each phase.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "phase_seconds_total counter\n");
+	for(i = 0; i < METRICS_DONE; ++i) {
+		fprintf(fp, METRICS_PREFIX "phase_seconds_total{phase=\"%s\"} %0.3f\n", phase_names[i], phase_seconds[i]);
+	}
+
+	fprintf(fp, "# HELP " METRICS_PREFIX "triplets_total Aggressor/victim triplets hammered and scanned.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "triplets_total counter\n");
+	fprintf(fp, METRICS_PREFIX "triplets_total %lu\n", m->triplets);
+
+	fprintf(fp, "# HELP " METRICS_PREFIX "flips_total Flipped bits by bank and direction.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "flips_total counter\n");
+	for(b = 0; b < MAX_CONTROLLED_BANKS; ++b) {
+		if(m->flips[b][0] + m->flips[b][1]) {
+			fprintf(fp, METRICS_PREFIX "flips_total{bank=\"%u\",direction=\"0to1\"} %lu\n", b, m->flips[b][0]);
+			fprintf(fp, METRICS_PREFIX "flips_total{bank=\"%u\",direction=\"1to0\"} %lu\n", b, m->flips[b][1]);
+		}
+	}
+
+	fprintf(fp, "# HELP " METRICS_PREFIX "activations_total Row activations issued.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "activations_total counter\n");
+	fprintf(fp, METRICS_PREFIX "activations_total %lu\n", m->activations);
+	fprintf(fp, "# HELP " METRICS_PREFIX "hammer_seconds_total Time spent in the hammer kernels.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "hammer_seconds_total counter\n");
+	fprintf(fp, METRICS_PREFIX "hammer_seconds_total %0.3f\n", m->hammer_ns / 1e9);
+	fprintf(fp, "# HELP " METRICS_PREFIX "activation_rate Activations per second and bank of the last triplet.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "activation_rate gauge\n");
+	fprintf(fp, METRICS_PREFIX "activation_rate %0.0f\n", m->acts_per_sec);
+
+	fprintf(fp, "# HELP " METRICS_PREFIX "buffers_mapped_total Buffers set up.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "buffers_mapped_total counter\n");
+	fprintf(fp, METRICS_PREFIX "buffers_mapped_total %lu\n", m->buffers_mapped);
+	fprintf(fp, "# HELP " METRICS_PREFIX "buffers_huge_total Buffers set up on a transparent huge page.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "buffers_huge_total counter\n");
+	fprintf(fp, METRICS_PREFIX "buffers_huge_total %lu\n", m->buffers_huge);
+	fprintf(fp, "# HELP " METRICS_PREFIX "buffer_setup_failures_total Buffers which could not be mapped.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "buffer_setup_failures_total counter\n");
+	fprintf(fp, METRICS_PREFIX "buffer_setup_failures_total %lu\n", m->buffer_failures);
+
+	fprintf(fp, "# HELP " METRICS_PREFIX "last_update_seconds Unix time of this file.\n");
+	fprintf(fp, "# TYPE " METRICS_PREFIX "last_update_seconds gauge\n");
+	fprintf(fp, METRICS_PREFIX "last_update_seconds %ld\n", (long) time(NULL));
+}
+
+static int __metrics_write(metrics_t *m)
+{
+	int rv;
+
+	if((rv = save_atomic(m->path, __metrics_print, m)) == 0) {
+		m->last_write_ns = timing_now_ns();
+	}
+	return rv;
+}
+
+/* Write to <path>.tmp and rename, the collector never
+   reads a half written file. */
+int metrics_write(metrics_t *m)
+{
+	int rv;
+
+	pthread_mutex_lock(&m->lock);
+	rv = __metrics_write(m);
+	pthread_mutex_unlock(&m->lock);
+	return rv;
+}
+
+/* Count a triplet, rewriting the file if the last
+   write is older than METRICS_INTERVAL_NS. */
+void metrics_result(metrics_t *m, const hammer_result_t *result)
+{
+	pthread_mutex_lock(&m->lock);
+	m->triplets++;
+	if(result->bank < MAX_CONTROLLED_BANKS) {
+		m->flips[result->bank][0] += result->flips_0_to_1;
+		m->flips[result->bank][1] += result->flips_1_to_0;
+	}
+	m->activations += result->activations;
+	m->hammer_ns += result->elapsed_ns;
+	m->acts_per_sec = result->acts_per_sec;
+	if(timing_now_ns() - m->last_write_ns >= METRICS_INTERVAL_NS) {
+		__metrics_write(m);
+	}
+	pthread_mutex_unlock(&m->lock);
+}
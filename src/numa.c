@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <inttypes.h>
+#include <sys/syscall.h>
+#include "numa.h"
+
+/* Parse a sysfs cpulist ("0-3,8,10-11") into a cpu set. */
+int numa_parse_cpulist(const char *list, cpu_set_t *set)
+{
+	char *end;
+	long lo, hi;
+
+	CPU_ZERO(set);
+	while(*list && *list != '\n') {
+		lo = strtol(list, &end, 10);
+		if(end == list) {
+			return -1;
+		}
+		hi = lo;
+		list = end;
+		if(*list == '-') {
+			++list;
+			hi = strtol(list, &end, 10);
+			if(end == list) {
+				return -1;
+			}
+			list = end;
+		}
+		for(; lo <= hi && lo < CPU_SETSIZE; ++lo) {
+			CPU_SET(lo, set);
+		}
+		if(*list == ',') {
+			++list;
+		}
+	}
+
+	return 0;
+}
+
+static int __numa_read_line(const char *path, char *line, size_t sz)
+{
+	FILE *fp;
+	int rv;
+
+	fp = fopen(path, "r");
+	if(fp == NULL) {
+		return -1;
+	}
+	rv = fgets(line, sz, fp) == NULL ? -1 : 0;
+	fclose(fp);
+	return rv;
+}
+
+/* Discover the online nodes and their local CPUs from sysfs.
+   Without NUMA, a single node 0 with all usable CPUs is reported. */
+void numa_discover(numa_topology_t *topo)
+{
+	char path[128], line[4096];
+	int node, cpu;
+
+	topo->nnodes = 0;
+	for(node = 0; node < NUMA_MAX_NODES; ++node) {
+		snprintf(path, sizeof(path), NUMA_SYSFS_NODES "/node%d/cpulist", node);
+		if(__numa_read_line(path, line, sizeof(line))) {
+			continue;
+		}
+		if(numa_parse_cpulist(line, &topo->cpus[topo->nnodes])) {
+			continue;
+		}
+		/* Memory-only nodes have nothing to pin to. */
+		if(CPU_COUNT(&topo->cpus[topo->nnodes]) == 0) {
+			continue;
+		}
+
+		topo->node_ids[topo->nnodes] = node;
+		topo->socket_ids[topo->nnodes] = -1;
+		for(cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if(!CPU_ISSET(cpu, &topo->cpus[topo->nnodes])) {
+				continue;
+			}
+			snprintf(path, sizeof(path), NUMA_SYSFS_CPUS "/cpu%d/topology/physical_package_id", cpu);
+			if(!__numa_read_line(path, line, sizeof(line))) {
+				topo->socket_ids[topo->nnodes] = atoi(line);
+			}
+			break;
+		}
+		topo->nnodes++;
+	}
+
+	if(topo->nnodes == 0) {
+		topo->nnodes = 1;
+		topo->node_ids[0] = 0;
+		topo->socket_ids[0] = 0;
+		sched_getaffinity(0, sizeof(cpu_set_t), &topo->cpus[0]);
+	}
+}
+
+/* Index of node in topo, or -1 if it is not there. */
+int numa_node_index(numa_topology_t *topo, int node)
+{
+	unsigned i;
+
+	for(i = 0; i < topo->nnodes; ++i) {
+		if(topo->node_ids[i] == node) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* Bind [addr, addr + len) to node. Has to happen before
+   the pages are first touched (i.e. before mlock). */
+int numa_bind_buffer(void *addr, size_t len, int node)
+{
+	unsigned long nodemask[NUMA_MAX_NODES / (8 * sizeof(unsigned long)) + 1];
+
+	memset(nodemask, 0, sizeof(nodemask));
+	nodemask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+	return syscall(SYS_mbind, addr, len, NUMA_MPOL_BIND, nodemask,
+				   NUMA_MAX_NODES + 1, NUMA_MPOL_MF_STRICT | NUMA_MPOL_MF_MOVE);
+}
+
+/* Pin the calling thread to the CPUs of node and make
+   its other allocations node local too. */
+int numa_pin_thread(numa_topology_t *topo, int node)
+{
+	unsigned long nodemask[NUMA_MAX_NODES / (8 * sizeof(unsigned long)) + 1];
+	int idx;
+
+	idx = numa_node_index(topo, node);
+	if(idx < 0) {
+		return -1;
+	}
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &topo->cpus[idx])) {
+		return -1;
+	}
+
+	memset(nodemask, 0, sizeof(nodemask));
+	nodemask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+	return syscall(SYS_set_mempolicy, NUMA_MPOL_BIND, nodemask, NUMA_MAX_NODES + 1);
+}
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perf.h"
+
+static int __perf_open(struct perf_event_attr *attr, pid_t pid, int cpu)
+{
+	return syscall(SYS_perf_event_open, attr, pid, cpu, -1, 0);
+}
+
+static int __perf_open_core(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return __perf_open(&attr, 0, -1);
+}
+
+static int __perf_read_sysfs(const char *path, char *line, size_t sz)
+{
+	FILE *fp;
+	char *nl;
+
+	fp = fopen(path, "r");
+	if(fp == NULL) {
+		return -1;
+	}
+	if(fgets(line, sz, fp) == NULL) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	if((nl = strchr(line, '\n')) != NULL) {
+		*nl = '\0';
+	}
+	return 0;
+}
+
+/* Translate a sysfs event string ("event=0x04,umask=0x03")
+   into a config value using the PMU's format/ description. */
+static int __perf_event_config(const char *pmu, const char *event, uint64_t *config)
+{
+	char path[256], desc[256], fmt[64], *term, *save, *val;
+	unsigned lo;
+
+	snprintf(path, sizeof(path), PERF_SYSFS_PMUS "/%s/events/%s", pmu, event);
+	if(__perf_read_sysfs(path, desc, sizeof(desc))) {
+		return -1;
+	}
+
+	*config = 0;
+	for(term = strtok_r(desc, ",", &save); term; term = strtok_r(NULL, ",", &save)) {
+		if((val = strchr(term, '=')) == NULL) {
+			return -1;
+		}
+		*val++ = '\0';
+		snprintf(path, sizeof(path), PERF_SYSFS_PMUS "/%s/format/%s", pmu, term);
+		if(__perf_read_sysfs(path, fmt, sizeof(fmt)) || sscanf(fmt, "config:%u", &lo) != 1) {
+			return -1;
+		}
+		*config |= strtoull(val, NULL, 0) << lo;
+	}
+
+	return 0;
+}
+
+/* Open a system-wide uncore counter on every
+   IMC box which knows about event. */
+static unsigned __perf_open_imc(const char *event, int *fds)
+{
+	struct perf_event_attr attr;
+	char pmu[64], path[256], line[64];
+	uint64_t config;
+	unsigned i, n;
+	int fd;
+
+	n = 0;
+	for(i = 0; i < PERF_MAX_IMC; ++i) {
+		snprintf(pmu, sizeof(pmu), "uncore_imc_%u", i);
+		snprintf(path, sizeof(path), PERF_SYSFS_PMUS "/%s/type", pmu);
+		if(__perf_read_sysfs(path, line, sizeof(line))) {
+			continue;
+		}
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = atoi(line);
+		attr.disabled = 1;
+		if(__perf_event_config(pmu, event, &config)) {
+			continue;
+		}
+		attr.config = config;
+
+		snprintf(path, sizeof(path), PERF_SYSFS_PMUS "/%s/cpumask", pmu);
+		if(__perf_read_sysfs(path, line, sizeof(line))) {
+			continue;
+		}
+		if((fd = __perf_open(&attr, -1, atoi(line))) >= 0) {
+			fds[n++] = fd;
+		}
+	}
+
+	return n;
+}
+
+/* Open the counters for the calling thread. Counters which are
+   not supported (or not permitted) are left at -1. Returns -1, with
+   everything closed again, if not even the core counters could be
+   opened. */
+int perf_open(perf_counters_t *pc)
+{
+	pc->llc_misses = __perf_open_core(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	pc->l1d_loads = __perf_open_core(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+									 (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+									 (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16));
+	pc->cycles = __perf_open_core(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	pc->nimc_cas = __perf_open_imc("cas_count_read", pc->imc_cas);
+	pc->nimc_act = __perf_open_imc("act_count", pc->imc_act);
+
+	if(pc->llc_misses < 0 && pc->cycles < 0) {
+		perf_close(pc);
+		return -1;
+	}
+	return 0;
+}
+
+void perf_close(perf_counters_t *pc)
+{
+	unsigned i;
+
+	if(pc->llc_misses >= 0) close(pc->llc_misses);
+	if(pc->l1d_loads >= 0) close(pc->l1d_loads);
+	if(pc->cycles >= 0) close(pc->cycles);
+	for(i = 0; i < pc->nimc_cas; ++i) close(pc->imc_cas[i]);
+	for(i = 0; i < pc->nimc_act; ++i) close(pc->imc_act[i]);
+}
+
+static void __perf_ioctl(perf_counters_t *pc, unsigned long req)
+{
+	unsigned i;
+
+	if(pc->llc_misses >= 0) ioctl(pc->llc_misses, req, 0);
+	if(pc->l1d_loads >= 0) ioctl(pc->l1d_loads, req, 0);
+	if(pc->cycles >= 0) ioctl(pc->cycles, req, 0);
+	for(i = 0; i < pc->nimc_cas; ++i) ioctl(pc->imc_cas[i], req, 0);
+	for(i = 0; i < pc->nimc_act; ++i) ioctl(pc->imc_act[i], req, 0);
+}
+
+static uint64_t __perf_read(int fd)
+{
+	uint64_t val;
+
+	if(fd < 0 || read(fd, &val, sizeof(val)) != sizeof(val)) {
+		return 0;
+	}
+	return val;
+}
+
+void perf_begin(perf_counters_t *pc, uint64_t now_ns)
+{
+	__perf_ioctl(pc, PERF_EVENT_IOC_RESET);
+	__perf_ioctl(pc, PERF_EVENT_IOC_ENABLE);
+	pc->t_start = now_ns;
+}
+
+/* Stop counting and derive the per-iteration miss rate and the
+   activation rate. nominal_acts is what the kernel issued; it is
+   used for the rate when no IMC ACT counter is available. */
+void perf_end(perf_counters_t *pc, uint64_t now_ns, uint64_t iterations, uint64_t nominal_acts, perf_sample_t *sample)
+{
+	unsigned i;
+
+	__perf_ioctl(pc, PERF_EVENT_IOC_DISABLE);
+
+	memset(sample, 0, sizeof(*sample));
+	sample->elapsed_ns = now_ns - pc->t_start;
+	sample->iterations = iterations;
+	sample->llc_misses = __perf_read(pc->llc_misses);
+	sample->l1d_loads = __perf_read(pc->l1d_loads);
+	sample->cycles = __perf_read(pc->cycles);
+	for(i = 0; i < pc->nimc_cas; ++i) sample->imc_cas += __perf_read(pc->imc_cas[i]);
+	for(i = 0; i < pc->nimc_act; ++i) sample->imc_act += __perf_read(pc->imc_act[i]);
+
+	sample->misses_per_iter = iterations ? (double) sample->llc_misses / iterations : 0;
+	sample->imc_measured = pc->nimc_act > 0;
+	if(sample->elapsed_ns) {
+		sample->acts_per_sec = (double) (sample->imc_measured ? sample->imc_act : nominal_acts) * 1e9 / sample->elapsed_ns;
+	}
+}
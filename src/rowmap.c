@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "rowmap.h"
+
+/* Logical row r is physically adjacent to r - 1 and r + 1. */
+void rowmap_identity(row_map_t *map, const char *profile, unsigned nrows)
+{
+	unsigned r;
+
+	memset(map, 0, sizeof(*map));
+	snprintf(map->profile, ROWMAP_PROFILE_LEN, "%s", profile);
+	map->nrows = nrows;
+	for(r = 0; r < nrows; ++r) {
+		map->neighbours[r][0] = r > 0 ? (int16_t) r - 1 : ROWMAP_NO_ROW;
+		map->neighbours[r][1] = r + 1 < nrows ? (int16_t) r + 1 : ROWMAP_NO_ROW;
+	}
+}
+
+unsigned rowmap_ninferred(row_map_t *map)
+{
+	unsigned r, n;
+
+	for(r = 0, n = 0; r < map->nrows; ++r) {
+		n += map->inferred[r];
+	}
+	return n;
+}
+
+/* Physical neighbours of victim, i.e. the aggressors for
+   double-sided hammering. -1 if the victim has no two. */
+int rowmap_aggressors(row_map_t *map, unsigned victim, unsigned *agg1, unsigned *agg2)
+{
+	if(victim >= map->nrows ||
+	   map->neighbours[victim][0] == ROWMAP_NO_ROW ||
+	   map->neighbours[victim][1] == ROWMAP_NO_ROW) {
+		return -1;
+	}
+
+	*agg1 = map->neighbours[victim][0];
+	*agg2 = map->neighbours[victim][1];
+	return 0;
+}
+
+/* Build the map from single-sided evidence: evidence[a][r] is the
+   number of flips seen in row r while hammering aggressor a. The two
+   rows with the strongest (symmetric) evidence become the neighbours.
+   Rows without any evidence keep their logical neighbours, rows with
+   a single one can't be a double-sided victim. */
+void rowmap_from_evidence(row_map_t *map, uint64_t evidence[][ROWMAP_MAX_ROWS])
+{
+	uint64_t score, best[2];
+	unsigned v, r;
+	int16_t pick[2];
+
+	for(v = 0; v < map->nrows; ++v) {
+		best[0] = best[1] = 0;
+		pick[0] = pick[1] = ROWMAP_NO_ROW;
+		for(r = 0; r < map->nrows; ++r) {
+			if(r == v) {
+				continue;
+			}
+			score = evidence[r][v] + evidence[v][r];
+			if(score > best[0]) {
+				best[1] = best[0];
+				pick[1] = pick[0];
+				best[0] = score;
+				pick[0] = r;
+			}
+			else if(score > best[1]) {
+				best[1] = score;
+				pick[1] = r;
+			}
+		}
+
+		if(pick[0] == ROWMAP_NO_ROW) {
+			continue;
+		}
+		if(pick[1] != ROWMAP_NO_ROW && pick[1] < pick[0]) {
+			map->neighbours[v][0] = pick[1];
+			map->neighbours[v][1] = pick[0];
+		}
+		else {
+			map->neighbours[v][0] = pick[0];
+			map->neighbours[v][1] = pick[1];
+		}
+		map->inferred[v] = 1;
+	}
+}
+
+/* File format: a "profile <name> <nrows>" line followed by
+   one "<row> <neighbour> <neighbour> <inferred>" line per row. */
+int rowmap_save(row_map_t *map, const char *path)
+{
+	FILE *fp;
+	unsigned r;
+
+	fp = fopen(path, "w");
+	if(fp == NULL) {
+		return -1;
+	}
+
+	fprintf(fp, "profile %s %u\n", map->profile, map->nrows);
+	for(r = 0; r < map->nrows; ++r) {
+		fprintf(fp, "%u %d %d %u\n", r, map->neighbours[r][0], map->neighbours[r][1], map->inferred[r]);
+	}
+
+	return fclose(fp);
+}
+
+static int __rowmap_bad_row(int row, unsigned nrows)
+{
+	return row != ROWMAP_NO_ROW && (row < 0 || row >= (int) nrows);
+}
+
+/* Load a map saved for profile with nrows rows. Returns -1 if the
+   file is missing, malformed, belongs to another profile or geometry
+   or has a neighbour outside [0, nrows). */
+int rowmap_load(row_map_t *map, const char *path, const char *profile, unsigned nrows)
+{
+	char name[ROWMAP_PROFILE_LEN];
+	row_map_t tmp;
+	unsigned r, idx, inferred;
+	int n1, n2;
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if(fp == NULL) {
+		return -1;
+	}
+
+	memset(&tmp, 0, sizeof(tmp));
+	if(fscanf(fp, "profile %31s %u", name, &tmp.nrows) != 2 ||
+	   strcmp(name, profile) != 0 || tmp.nrows != nrows || tmp.nrows > ROWMAP_MAX_ROWS) {
+		fclose(fp);
+		return -1;
+	}
+	snprintf(tmp.profile, ROWMAP_PROFILE_LEN, "%s", name);
+
+	for(r = 0; r < tmp.nrows; ++r) {
+		if(fscanf(fp, "%u %d %d %u", &idx, &n1, &n2, &inferred) != 4 || idx != r ||
+		   __rowmap_bad_row(n1, tmp.nrows) || __rowmap_bad_row(n2, tmp.nrows)) {
+			fclose(fp);
+			return -1;
+		}
+		tmp.neighbours[r][0] = n1;
+		tmp.neighbours[r][1] = n2;
+		tmp.inferred[r] = inferred;
+	}
+
+	fclose(fp);
+	*map = tmp;
+	return 0;
+}
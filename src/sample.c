@@ -0,0 +1,197 @@
+#include <math.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdlib.h>
+#include "sample.h"
+
+static volatile sig_atomic_t sample_stop;
+
+static void sample_signal(int sig)
+{
+	(void) sig;
+	sample_stop = 1;
+}
+
+/* <threshold>[,<half width>[,<max units>]], fractions of units.
+   The half width defaults to a quarter of the threshold. */
+int sample_parse(sample_t *sample, const char *spec)
+{
+	char buf[128], *field, *save;
+	unsigned n;
+
+	memset(sample, 0, sizeof(sample_t));
+	strncpy(buf, spec, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+	for(n = 0, field = strtok_r(buf, ",", &save); field; ++n, field = strtok_r(NULL, ",", &save)) {
+		switch(n) {
+			case 0:
+				sample->threshold = atof(field);
+				break;
+			case 1:
+				sample->half_width = atof(field);
+				break;
+			case 2:
+				sample->max_units = strtoull(field, NULL, 10);
+				break;
+			default:
+				return -EINVAL;
+		}
+	}
+	if(sample->threshold <= 0 || sample->threshold >= 1 || sample->half_width < 0 || sample->half_width >= 1) {
+		return -EINVAL;
+	}
+	if(sample->half_width == 0) {
+		sample->half_width = sample->threshold / 4;
+	}
+	return 0;
+}
+
+/* Wilson score interval of vulnerable out of units */
+static void sample_interval(sample_t *sample)
+{
+	double n, p, z2, centre, spread;
+
+	n = sample->units;
+	p = sample->vulnerable / n;
+	z2 = SAMPLE_Z * SAMPLE_Z;
+	centre = (p + z2 / (2 * n)) / (1 + z2 / n);
+	spread = SAMPLE_Z * sqrt(p * (1 - p) / n + z2 / (4 * n * n)) / (1 + z2 / n);
+	sample->lower = fmax(0, centre - spread);
+	sample->upper = fmin(1, centre + spread);
+}
+
+static int sample_decide(sample_t *sample)
+{
+	if(sample->units < SAMPLE_MIN_UNITS) {
+		return SAMPLE_RUNNING;
+	}
+	if(sample->upper < sample->threshold) {
+		return SAMPLE_PASS;
+	}
+	if(sample->lower > sample->threshold) {
+		return SAMPLE_FAIL;
+	}
+	if((sample->upper - sample->lower) / 2 <= sample->half_width) {
+		return SAMPLE_PRECISE;
+	}
+	return SAMPLE_RUNNING;
+}
+
+const char *sample_verdict(int verdict)
+{
+	switch(verdict) {
+		case SAMPLE_PASS:
+			return "PASS";
+		case SAMPLE_FAIL:
+			return "FAIL";
+		case SAMPLE_PRECISE:
+			return "BORDERLINE";
+		case SAMPLE_EXHAUSTED:
+			return "INCONCLUSIVE";
+		default:
+			return "RUNNING";
+	}
+}
+
+static void sample_progress(sample_t *sample)
+{
+	pr_info("[SAMPLE] %lu units, %lu with flips: %0.4f [%0.4f, %0.4f] at %0.0f%%, %0.3f flips per M ACT\n",
+			sample->units, sample->vulnerable, (double) sample->vulnerable / sample->units, sample->lower,
+			sample->upper, 100 * erf(SAMPLE_Z / M_SQRT2),
+			sample->activations ? sample->flips * 1e6 / sample->activations : 0);
+	fflush(stdout);
+}
+
+/* Hammer units of the triplets of nbuffers buffers in an order
+   shuffled by seed until the interval decides against threshold,
+   is narrow enough, the pool or max_units runs out or a signal
+   arrives. The seed reproduces the order of units, the buffers are
+   backed by other physical pages every run. */
+int sample_run(hammer_ctx_t *ctx, sample_t *sample, unsigned first_slot, unsigned nbuffers)
+{
+	struct sigaction sa, old_int, old_term;
+	hammer_job_t *jobs, tmp;
+	hammer_result_t result;
+	uint64_t t_start, x;
+	unsigned buf, bank;
+	size_t njobs, i, j;
+	int rv;
+
+	jobs = calloc((size_t) nbuffers * ctx->dram.nbanks * MAX_CONTROLLED_ROWS, sizeof(hammer_job_t));
+	if(jobs == NULL) {
+		return -ENOMEM;
+	}
+	if((rv = hammer_ctx_map_buffers(ctx, first_slot, nbuffers))) {
+		goto out;
+	}
+
+	njobs = 0;
+	for(buf = 0; buf < nbuffers; ++buf) {
+		for(bank = 0; bank < ctx->dram.nbanks && bank < MAX_CONTROLLED_BANKS; ++bank) {
+			njobs += hammer_bank_jobs(ctx, buf, bank, jobs + njobs, MAX_CONTROLLED_ROWS);
+		}
+	}
+	if(njobs == 0) {
+		rv = -EINVAL;
+		goto out;
+	}
+
+	/* Fisher-Yates, xorshift needs a non-zero state */
+	x = sample->seed ? sample->seed : 1;
+	for(i = njobs - 1; i > 0; --i) {
+		j = xorshift64(&x) % (i + 1);
+		tmp = jobs[i];
+		jobs[i] = jobs[j];
+		jobs[j] = tmp;
+	}
+	if(sample->max_units == 0 || sample->max_units > njobs) {
+		sample->max_units = njobs;
+	}
+	pr_info("[SAMPLE] Seed %lu, %lu units in %u buffers, threshold %0.4f, half width %0.4f, at most %lu units\n",
+			sample->seed, njobs, nbuffers, sample->threshold, sample->half_width, sample->max_units);
+
+	sample_stop = 0;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sample_signal;
+	sigaction(SIGINT, &sa, &old_int);
+	sigaction(SIGTERM, &sa, &old_term);
+
+	t_start = timing_now_ns();
+	sample->verdict = SAMPLE_RUNNING;
+	for(i = 0; i < sample->max_units && !sample_stop && sample->verdict == SAMPLE_RUNNING; ++i) {
+		hammer_run_jobs(ctx, &jobs[i], 1, &result);
+		if(result.status) {
+			continue;
+		}
+		sample->units++;
+		sample->vulnerable += result.flips > 0;
+		sample->flips += result.flips;
+		sample->activations += result.activations;
+		sample_interval(sample);
+		sample->verdict = sample_decide(sample);
+		if(sample->units % SAMPLE_REPORT_EVERY == 0) {
+			sample_progress(sample);
+		}
+	}
+	sample->elapsed_ns = timing_now_ns() - t_start;
+
+	sigaction(SIGINT, &old_int, NULL);
+	sigaction(SIGTERM, &old_term, NULL);
+	if(sample_stop) {
+		pr_info("[SAMPLE] Interrupted, stopping\n");
+	}
+	if(sample->verdict == SAMPLE_RUNNING) {
+		sample->verdict = SAMPLE_EXHAUSTED;
+	}
+	if(sample->units) {
+		sample_progress(sample);
+	}
+	rv = 0;
+
+out:
+	hammer_ctx_unmap_buffers(ctx);
+	free(jobs);
+	return rv;
+}
@@ -0,0 +1,155 @@
+#include <time.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include "stats.h"
+
+static const char *phase_names[] = {"setup", "check", "sweep", "hammer", "scan", "done"};
+
+#define __stats_set(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#define __stats_add(field, value) __atomic_fetch_add(&(field), (value), __ATOMIC_RELAXED)
+#define __stats_get(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+/* Wall clock, the reader has no TSC calibration of ours */
+static uint64_t __stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Create the segment of this process, NULL if shm is not available. */
+stats_t *stats_create(void)
+{
+	char name[64];
+	stats_t *stats;
+	int fd;
+
+	snprintf(name, sizeof(name), STATS_NAME_FMT, getpid());
+	fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if(fd < 0) {
+		return NULL;
+	}
+	if(ftruncate(fd, sizeof(stats_t))) {
+		goto out;
+	}
+	stats = mmap(NULL, sizeof(stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(stats == MAP_FAILED) {
+		goto out;
+	}
+	close(fd);
+
+	memset(stats, 0, sizeof(stats_t));
+	stats->version = STATS_VERSION;
+	stats->pid = getpid();
+	stats->phase = STATS_SETUP;
+	stats->started_ns = stats->updated_ns = __stats_now();
+	/* Last, readers check it before anything else */
+	__atomic_store_n(&stats->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+	return stats;
+
+out:
+	close(fd);
+	shm_unlink(name);
+	return NULL;
+}
+
+/* Unmap and remove the segment, stats may be NULL. */
+void stats_destroy(stats_t *stats)
+{
+	char name[64];
+
+	if(stats == NULL) {
+		return;
+	}
+	snprintf(name, sizeof(name), STATS_NAME_FMT, stats->pid);
+	munmap(stats, sizeof(stats_t));
+	shm_unlink(name);
+}
+
+void stats_phase(stats_t *stats, unsigned phase)
+{
+	if(stats) {
+		__stats_set(stats->phase, phase);
+		__stats_set(stats->updated_ns, __stats_now());
+	}
+}
+
+/* A job goes to the hammer kernel */
+void stats_job(stats_t *stats, unsigned buffer, unsigned bank, unsigned row)
+{
+	if(stats) {
+		__stats_set(stats->buffer, buffer);
+		__stats_set(stats->bank, bank);
+		__stats_set(stats->row, row);
+		__stats_set(stats->phase, STATS_HAMMER);
+		__stats_set(stats->updated_ns, __stats_now());
+	}
+}
+
+/* A job's victim was scanned */
+void stats_result(stats_t *stats, uint64_t flips, uint64_t activations, uint64_t acts_per_sec)
+{
+	if(stats) {
+		__stats_add(stats->triplets, 1);
+		__stats_add(stats->flips, flips);
+		__stats_add(stats->activations, activations);
+		__stats_set(stats->acts_per_sec, acts_per_sec);
+		__stats_set(stats->updated_ns, __stats_now());
+	}
+}
+
+/* Print the segment of pid. Returns 0, -ENOENT without one,
+   -EPROTO if it is not a segment we can read. The segment of
+   a run that was killed is printed once and removed. */
+int stats_print(pid_t pid)
+{
+	char name[64];
+	stats_t *stats;
+	uint64_t now;
+	unsigned phase;
+	int fd, rv, gone;
+
+	snprintf(name, sizeof(name), STATS_NAME_FMT, pid);
+	fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0) {
+		return -errno;
+	}
+	stats = mmap(NULL, sizeof(stats_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(stats == MAP_FAILED) {
+		return -errno;
+	}
+
+	rv = 0;
+	if(__atomic_load_n(&stats->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC || stats->version != STATS_VERSION) {
+		rv = -EPROTO;
+		goto out;
+	}
+	now = __stats_now();
+	phase = __stats_get(stats->phase);
+	gone = kill(pid, 0) && errno == ESRCH;
+	printf("pid          %d%s\n", stats->pid, gone ? " (gone, last update below)" : "");
+	printf("phase        %s\n", phase <= STATS_DONE ? phase_names[phase] : "unknown");
+	printf("running      %0.1f s, updated %0.1f s ago\n", (now - stats->started_ns) / 1e9,
+		   (now - __stats_get(stats->updated_ns)) / 1e9);
+	printf("buffer       %u\n", __stats_get(stats->buffer));
+	printf("bank         %u\n", __stats_get(stats->bank));
+	printf("row          %u\n", __stats_get(stats->row));
+	printf("triplets     %lu\n", __stats_get(stats->triplets));
+	printf("flips        %lu\n", __stats_get(stats->flips));
+	printf("activations  %lu\n", __stats_get(stats->activations));
+	printf("ACT/s        %0.2f M per bank\n", __stats_get(stats->acts_per_sec) / 1e6);
+	if(gone) {
+		shm_unlink(name);
+	}
+
+out:
+	munmap(stats, sizeof(stats_t));
+	return rv;
+}
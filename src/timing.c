@@ -0,0 +1,74 @@
+#include <time.h>
+#include <stdlib.h>
+#include <cpuid.h>
+#include <inttypes.h>
+#include "timing.h"
+
+tsc_calibration_t tsc_cal = {0, 0.0, 0};
+
+static int __timing_compare(const void *t1, const void *t2)
+{
+	uint64_t val1, val2;
+
+	val1 = *(const uint64_t *) t1;
+	val2 = *(const uint64_t *) t2;
+	return (val1 > val2) - (val1 < val2);
+}
+
+/* CPUID.80000007H:EDX[8] */
+static uint8_t __tsc_is_invariant(void)
+{
+	unsigned eax, ebx, ecx, edx;
+
+	if(!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) {
+		return 0;
+	}
+	__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	return (edx >> 8) & 1;
+}
+
+/* Check for an invariant TSC, measure its frequency against
+   CLOCK_MONOTONIC and the cost of an empty measurement.
+   Returns -1 if the TSC is not invariant, the calibration
+   is still filled in but wall-clock times avoid the TSC. */
+int timing_init(void)
+{
+	uint64_t c_start, c_end, ns_start, ns_end;
+	uint64_t *samples;
+	double freqs[TSC_CALIBRATION_RUNS], tmp;
+	unsigned i, j;
+
+	tsc_cal.invariant = __tsc_is_invariant();
+
+	for(i = 0; i < TSC_CALIBRATION_RUNS; ++i) {
+		ns_start = __clock_monotonic_ns();
+		c_start = tsc_begin();
+		do {
+			ns_end = __clock_monotonic_ns();
+		} while(ns_end - ns_start < TSC_CALIBRATION_NS);
+		c_end = tsc_end();
+		freqs[i] = (double) (c_end - c_start) / (ns_end - ns_start);
+	}
+	for(i = 1; i < TSC_CALIBRATION_RUNS; ++i) {
+		for(j = i; j > 0 && freqs[j - 1] > freqs[j]; --j) {
+			tmp = freqs[j];
+			freqs[j] = freqs[j - 1];
+			freqs[j - 1] = tmp;
+		}
+	}
+	tsc_cal.ticks_per_ns = freqs[TSC_CALIBRATION_RUNS / 2];
+
+	samples = malloc(TSC_OVERHEAD_SAMPLES * sizeof(uint64_t));
+	if(samples != NULL) {
+		for(i = 0; i < TSC_OVERHEAD_SAMPLES; ++i) {
+			c_start = tsc_begin();
+			c_end = tsc_end();
+			samples[i] = c_end - c_start;
+		}
+		qsort(samples, TSC_OVERHEAD_SAMPLES, sizeof(uint64_t), __timing_compare);
+		tsc_cal.overhead = samples[TSC_OVERHEAD_SAMPLES / 2];
+		free(samples);
+	}
+
+	return tsc_cal.invariant ? 0 : -1;
+}